@@ -20,6 +20,16 @@ extern "C" {
 #include <stdarg.h>
 #include <time.h>
 
+/**
+ * @brief Version of the layout of the public structures
+ *
+ * Bumped whenever fields of @ref logmod or @ref logmod_logger are moved,
+ * added or removed (undefined by releases predating it). Translation units
+ * sharing those structures must agree on it, as well as on the size macros
+ * below (such as @ref LOGMOD_CACHE_LINE_SIZE)
+ */
+#define LOGMOD_ABI_VERSION 1
+
 /**
  * @brief Format string checking attribute for printf-like functions
  *
@@ -55,6 +65,195 @@ extern "C" {
 #define LOGMOD_FALLBACK_CONTEXT_ID "GLOBAL"
 #endif /* LOGMOD_FALLBACK_CONTEXT_ID */
 
+/**
+ * @brief Minimum log level compiled into the logging macros
+ *
+ * Messages below this level are stripped at compile-time: their arguments
+ * are never evaluated and (with optimizations enabled) their format strings
+ * are not emitted into the binary. Can be overridden by defining this macro
+ * before including logmod.h (e.g., -DLOGMOD_COMPILE_MIN_LEVEL=2 or
+ * LOGMOD_LEVEL_INFO)
+ */
+#ifndef LOGMOD_COMPILE_MIN_LEVEL
+#define LOGMOD_COMPILE_MIN_LEVEL LOGMOD_LEVEL_TRACE
+#endif /* LOGMOD_COMPILE_MIN_LEVEL */
+
+/**
+ * @brief Size of the buffer a log record is rendered into
+ *
+ * Records that fit are written with a single call per output, so lines from
+ * different threads never interleave. Larger records are streamed instead.
+ * Can be overridden by defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_BUFFER_SIZE
+#define LOGMOD_BUFFER_SIZE 4096
+#endif /* LOGMOD_BUFFER_SIZE */
+
+/**
+ * @brief Maximum size of a rendered record prefix
+ *
+ * Counter, time, application id, context id, label and file:line, including
+ * ANSI color sequences. Longer prefixes are truncated. Can be overridden by
+ * defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_PREFIX_SIZE
+#define LOGMOD_PREFIX_SIZE 512
+#endif /* LOGMOD_PREFIX_SIZE */
+
+/**
+ * @brief Size of a logger's pre-rendered application and context IDs
+ *
+ * Holds both the plain and the colored rendering. Loggers whose IDs don't
+ * fit render them on every record instead. Can be overridden by defining
+ * this macro before including logmod.h
+ */
+#ifndef LOGMOD_IDENTITY_SIZE
+#define LOGMOD_IDENTITY_SIZE 128
+#endif /* LOGMOD_IDENTITY_SIZE */
+
+/**
+ * @brief Size of a cache line
+ *
+ * Fields written on every logged record are padded by this much, so that
+ * they don't share a cache line with fields read by other threads. Can be
+ * overridden by defining this macro before including logmod.h (e.g., 128
+ * on CPUs that fetch cache lines in pairs)
+ */
+#ifndef LOGMOD_CACHE_LINE_SIZE
+#define LOGMOD_CACHE_LINE_SIZE 64
+#elif LOGMOD_CACHE_LINE_SIZE < 16
+#error "LOGMOD_CACHE_LINE_SIZE must be at least 16"
+#endif /* LOGMOD_CACHE_LINE_SIZE */
+
+/**
+ * @brief Padding of `_size` bytes, reduced to one byte if
+ * LOGMOD_NO_CACHE_LINE_PADDING is defined
+ *
+ * Defining LOGMOD_NO_CACHE_LINE_PADDING before including logmod.h packs
+ * the fields written per record next to the ones read by other threads, as
+ * they were before padding was introduced, e.g., to measure what the
+ * padding saves.
+ */
+#ifdef LOGMOD_NO_CACHE_LINE_PADDING
+#define _LOGMOD_PADDING(_name, _size) char _name[1]
+#else
+#define _LOGMOD_PADDING(_name, _size) char _name[_size]
+#endif /* LOGMOD_NO_CACHE_LINE_PADDING */
+
+/**
+ * @brief Maximum number of sinks attached to a logger (at most 8)
+ *
+ * Can be overridden by defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_MAX_SINKS
+#define LOGMOD_MAX_SINKS 4
+#elif LOGMOD_MAX_SINKS > 8
+#error "LOGMOD_MAX_SINKS must be at most 8"
+#endif /* LOGMOD_MAX_SINKS */
+
+/**
+ * @brief Number of levels whose sink routing is precomputed per logger
+ *
+ * Records of higher (custom) levels are routed by checking each sink. Can
+ * be overridden by defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_SINK_LEVELS
+#define LOGMOD_SINK_LEVELS 16
+#endif /* LOGMOD_SINK_LEVELS */
+
+/**
+ * @brief Maximum number of pieces a line is written as, by sinks that take
+ * segments
+ *
+ * Must not exceed the platform's IOV_MAX for file descriptor sinks
+ */
+#ifndef LOGMOD_MAX_SEGMENTS
+#define LOGMOD_MAX_SEGMENTS 16
+#endif /* LOGMOD_MAX_SEGMENTS */
+
+/** @brief Defined if file descriptor sinks are available (POSIX) */
+#if !defined(LOGMOD_FD_SINK) && (defined(__unix__) || defined(__APPLE__))
+#define LOGMOD_FD_SINK
+#endif
+
+/**
+ * @brief Memory-mapped file sinks (POSIX, and the atomic operations of GCC,
+ * Clang or C11), opt-in
+ *
+ * Define before including logmod.h. Needs ftruncate() to be declared, e.g.
+ * with `_POSIX_C_SOURCE` 200112L.
+ */
+#if defined(LOGMOD_MMAP_SINK) && !defined(LOGMOD_FD_SINK)
+#error "LOGMOD_MMAP_SINK requires POSIX"
+#endif
+
+/**
+ * @brief Rotating file sinks (POSIX threads, and the atomic operations of
+ * GCC, Clang or C11), opt-in
+ *
+ * Define before including logmod.h, and link with `-pthread`.
+ */
+#if defined(LOGMOD_ROTATING_SINK) && !defined(LOGMOD_FD_SINK)
+#error "LOGMOD_ROTATING_SINK requires POSIX"
+#endif
+
+/**
+ * @brief Size of the path names of rotating file sinks, rotation suffix and
+ * terminating '\0' included
+ */
+#ifndef LOGMOD_PATH_SIZE
+#define LOGMOD_PATH_SIZE 4096
+#endif /* LOGMOD_PATH_SIZE */
+
+/**
+ * @brief Number of windows a memory-mapped file sink keeps mapped at once
+ *
+ * Records reserved this many windows ahead of the oldest unfinished one
+ * wait for it to be filled
+ */
+#ifndef LOGMOD_MMAP_WINDOWS
+#define LOGMOD_MMAP_WINDOWS 4
+#endif /* LOGMOD_MMAP_WINDOWS */
+
+/**
+ * @brief io_uring file sinks (Linux), opt-in
+ *
+ * Define before including logmod.h. Needs syscall() to be declared, e.g.
+ * with `_DEFAULT_SOURCE`.
+ */
+#if defined(LOGMOD_URING_SINK) && !defined(__linux__)
+#error "LOGMOD_URING_SINK requires Linux"
+#endif
+
+/** @brief Maximum number of buffers of an io_uring sink */
+#ifndef LOGMOD_URING_BUFFERS
+#define LOGMOD_URING_BUFFERS 16
+#endif /* LOGMOD_URING_BUFFERS */
+
+/**
+ * @brief Durable (group commit) file sinks (POSIX threads), opt-in
+ *
+ * Define before including logmod.h, and link with `-pthread`.
+ */
+#if defined(LOGMOD_DURABLE_SINK) && !defined(LOGMOD_FD_SINK)
+#error "LOGMOD_DURABLE_SINK requires POSIX"
+#endif
+
+/**
+ * @brief Unsigned 64-bit integer type
+ *
+ * Used for nanosecond timestamps and clock readings
+ */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+typedef unsigned long long logmod_uint64;
+#elif defined(__GNUC__)
+__extension__ typedef unsigned long long logmod_uint64;
+#elif defined(_MSC_VER)
+typedef unsigned __int64 logmod_uint64;
+#else
+typedef unsigned long logmod_uint64;
+#endif
+
 /**
  * @brief Log levels supported by LogMod
  *
@@ -82,9 +281,84 @@ typedef enum {
     LOGMOD_OK = 0, /**< Success */
     LOGMOD_OK_CONTINUE, /**< Success, continue with default behavior */
     LOGMOD_OK_SKIPPED /**< Success, logger has been skipped from logging due to
-                         being disabled by user */
+                         being disabled or filtered by level, or the record
+                         has been dropped as per the overflow policy */
 } logmod_err;
 
+/**
+ * @brief Clock sources a logging context can timestamp entries with
+ *
+ * Every source yields nanoseconds since the Unix epoch. Monotonic sources are
+ * anchored to the wall-clock when selected, and don't follow wall-clock
+ * adjustments from then on.
+ */
+enum logmod_clocks {
+    LOGMOD_CLOCK_REALTIME = 0, /**< Wall-clock (default) */
+    LOGMOD_CLOCK_REALTIME_COARSE, /**< Wall-clock, cheaper to read but only
+                                     updated every few milliseconds */
+    LOGMOD_CLOCK_MONOTONIC, /**< Monotonic clock */
+    LOGMOD_CLOCK_TSC /**< CPU timestamp counter, calibrated against the
+                        monotonic clock (x86 only) */
+};
+
+/**
+ * @brief What logging calls do when the asynchronous queue is full
+ *
+ * @see logmod_set_overflow_policy()
+ */
+enum logmod_overflow_policies {
+    LOGMOD_OVERFLOW_BLOCK = 0, /**< Wait for the writer (default) */
+    LOGMOD_OVERFLOW_DROP_NEWEST, /**< Drop the record being logged */
+    LOGMOD_OVERFLOW_DROP_OLDEST, /**< Drop the oldest queued records to make
+                                    room for the record being logged */
+    LOGMOD_OVERFLOW_DROP_BELOW /**< Drop records below a given level, wait
+                                  for the others (ERROR and FATAL always
+                                  wait) */
+};
+
+/**
+ * @brief How the time is rendered in log messages
+ */
+enum logmod_time_formats {
+    LOGMOD_TIME_HMS = 0, /**< HH:MM:SS (default) */
+    LOGMOD_TIME_HMS_USEC, /**< HH:MM:SS.uuuuuu */
+    LOGMOD_TIME_ISO8601 /**< YYYY-MM-DDTHH:MM:SS.uuuuuu+hh:mm */
+};
+
+/**
+ * @brief When records written to a logfile or binary stream are flushed
+ *
+ * A record is flushed as soon as any of the limits is reached. If every
+ * field is 0, each record is flushed as it is written. Console output is
+ * always flushed after each record.
+ */
+struct logmod_flush_policy {
+    unsigned long records; /**< Flush once this many records are pending,
+                              or 0 for no limit */
+    size_t bytes; /**< Flush once this many bytes are pending (payload bytes
+                     for binary streams), or 0 for no limit */
+    unsigned long interval_ms; /**< Flush once the oldest pending record is
+                                  this many milliseconds old, or 0 for no
+                                  limit */
+    unsigned level; /**< Flush at once records at or above this level (e.g.,
+                       LOGMOD_LEVEL_ERROR), or 0 to only rely on the limits
+                       above */
+};
+
+/**
+ * @brief Output written to a logfile or binary stream since it was last
+ * flushed
+ */
+struct logmod_flush_state {
+    unsigned long records; /**< Number of pending records */
+    size_t bytes; /**< Number of pending bytes */
+    logmod_uint64 since; /**< Timestamp of the oldest pending record */
+};
+
+/* forward declaration */
+struct logmod_binary;
+/**/
+
 /**
  * @brief Configuration options for a logger
  */
@@ -97,6 +371,16 @@ struct logmod_options {
     unsigned level; /**< Minimum level to log (suppress messages below this) */
     int suppress_time; /**< If 1, suppress time in log messages */
     int hide_counter; /**< If 1, hide message counter in log messages */
+    int callback_all_levels; /**< If 1, callback also receives messages below
+                                `level` */
+    unsigned time_format; /**< Time rendering (@ref logmod_time_formats) */
+    int defer_formatting; /**< If 1, in asynchronous mode, messages are
+                             formatted by the writer thread (ignored when the
+                             logger has a callback) */
+    struct logmod_binary *binary; /**< Binary stream to write logs to instead
+                                     of logfile, or NULL */
+    struct logmod_flush_policy flush; /**< When the logfile or binary stream
+                                         is flushed */
 };
 
 /**
@@ -132,10 +416,18 @@ struct logmod_info {
     const unsigned level; /**< Log level */
     const struct logmod_label *const label; /**< Label for this log level */
     const struct tm time; /**< Time for when entry has been triggered */
+    const logmod_uint64 timestamp; /**< Nanoseconds since the Unix epoch for
+                                      when entry has been triggered */
+    const long counter; /**< Sequence number of the entry, from the global
+                           message counter */
+    const char *const message; /**< Formatted message body (may be truncated
+                                  to LOGMOD_BUFFER_SIZE) */
 };
 
 /* forward declaration */
+struct logmod;
 struct logmod_logger;
+struct logmod_async;
 struct tm;
 /**/
 
@@ -163,6 +455,207 @@ typedef logmod_err (*logmod_callback)(const struct logmod_logger *logger,
                                       const char *fmt,
                                       va_list args);
 
+/**
+ * @brief How records are rendered for a sink
+ */
+enum logmod_sink_formats {
+    LOGMOD_SINK_PLAIN = 0, /**< Text lines, as written to logfiles */
+    LOGMOD_SINK_COLOR, /**< Text lines with ANSI colors, as on the console */
+    LOGMOD_SINK_STRUCTURED /**< One JSON object per line */
+};
+
+/* forward declaration */
+struct logmod_sink;
+/**/
+
+/**
+ * @brief Piece of a rendered line
+ *
+ * @see logmod_sink_vtable::writev
+ */
+struct logmod_segment {
+    const char *data; /**< Start of the piece */
+    size_t length; /**< Length of the piece */
+};
+
+/**
+ * @brief Operations of a sink
+ */
+struct logmod_sink_vtable {
+    /** Write a rendered line (newline included), return LOGMOD_OK or an
+        error code */
+    logmod_err (*write)(struct logmod_sink *sink,
+                        const struct logmod_info *info,
+                        const char *line,
+                        size_t length);
+    /** Flush written lines, or NULL if the sink doesn't buffer */
+    logmod_err (*flush)(struct logmod_sink *sink);
+    /** Release the sink once detached from its last logger, or NULL */
+    void (*close)(struct logmod_sink *sink);
+    /** Write a line as up to LOGMOD_MAX_SEGMENTS consecutive pieces
+        (prefix, message, newline), with strings larger than the record
+        buffer left in place. If not NULL, used instead of `write` */
+    logmod_err (*writev)(struct logmod_sink *sink,
+                         const struct logmod_info *info,
+                         const struct logmod_segment segments[],
+                         unsigned count);
+};
+
+/**
+ * @brief Output records are dispatched to, besides the console and logfile
+ *
+ * Each sink has its own minimum level, rendering and flush policy. A sink
+ * can be attached to several loggers, its writes are then serialized by
+ * the sink itself. Its flush accounting (`pending`) is guarded by the
+ * logging context's lock, which is taken for the logger writing: the lock
+ * function must then exclude every logger the sink is attached to (e.g.,
+ * with a single mutex), not only the logger it is called for.
+ *
+ * @see logmod_sink_init(), logmod_logger_add_sink()
+ */
+struct logmod_sink {
+    const struct logmod_sink_vtable *vtable; /**< Sink operations */
+    void *data; /**< Sink state (the FILE of file sinks) */
+    unsigned level; /**< Minimum level written to the sink */
+    unsigned format; /**< Rendering (@ref logmod_sink_formats) */
+    struct logmod_flush_policy flush; /**< When the sink is flushed */
+    struct logmod_flush_state pending; /**< Records not flushed yet */
+    unsigned refs; /**< Number of loggers the sink is attached to */
+    int fd; /**< File descriptor of file descriptor sinks */
+};
+
+#ifdef LOGMOD_MMAP_SINK
+/**
+ * @brief Window of a memory-mapped file sink
+ *
+ * Slot `k % LOGMOD_MMAP_WINDOWS` maps windows `k`, `k +
+ * LOGMOD_MMAP_WINDOWS`, ... in turn, each once the previous one is filled.
+ */
+struct logmod_mmap_window {
+    char *base; /**< Mapping of the window */
+    logmod_uint64 index; /**< Window number + 1 while mapped, 0 otherwise */
+    logmod_uint64 next; /**< Window number the slot holds, or maps next */
+    size_t filled; /**< Bytes copied into the window so far */
+};
+
+/**
+ * @brief Memory-mapped file sink state
+ *
+ * Provided by the caller, see logmod_sink_init_mmap().
+ */
+struct logmod_mmap {
+    size_t window_size; /**< Size of a mapping, a multiple of the page size */
+    logmod_uint64 offset; /**< End of the space reserved by records */
+    logmod_uint64 allocated; /**< Size the file has been extended to */
+    logmod_uint64 lost; /**< Reserved bytes left as a hole, because their
+                           window couldn't be mapped */
+    int busy; /**< Spinlock guarding mappings and file extension */
+    struct logmod_mmap_window windows[LOGMOD_MMAP_WINDOWS]; /**< Slots */
+};
+#endif /* LOGMOD_MMAP_SINK */
+
+#ifdef LOGMOD_URING_SINK
+/** @brief Write of a buffer of an io_uring file sink */
+struct logmod_uring_write {
+    logmod_uint64 offset; /**< File offset of the unwritten part */
+    size_t done; /**< Bytes written already */
+    size_t length; /**< Bytes to write, 0 if the buffer is free */
+};
+
+/**
+ * @brief io_uring file sink state
+ *
+ * Provided by the caller, see logmod_sink_init_uring().
+ */
+struct logmod_uring {
+    int ring_fd; /**< io_uring instance, -1 once closed */
+    int fixed; /**< Whether the buffers are registered with the ring */
+    int busy; /**< Spinlock guarding the rings and buffers */
+    int waiting; /**< 1 while a thread waits for a write without holding
+                    `busy`, completions being left to it meanwhile */
+    int error; /**< errno of a failed write, not reported yet */
+    char *buffers; /**< `num_buffers` buffers of `buffer_size` bytes */
+    size_t buffer_size; /**< Size of each buffer */
+    unsigned num_buffers; /**< Number of buffers */
+    unsigned current; /**< Buffer being filled */
+    size_t filled; /**< Bytes copied into the current buffer */
+    unsigned in_flight; /**< Number of buffers being written */
+    logmod_uint64 offset; /**< File offset of the current buffer */
+    struct logmod_uring_write writes[LOGMOD_URING_BUFFERS]; /**< Per buffer */
+    void *sq_ring, *cq_ring, *sqes; /**< Ring mappings */
+    size_t sq_ring_size, cq_ring_size, sqes_size; /**< Mapping sizes */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array; /**< Submission ring */
+    unsigned *cq_head, *cq_tail, *cq_mask; /**< Completion ring */
+    void *cqes; /**< Completion entries */
+};
+#endif /* LOGMOD_URING_SINK */
+
+#ifdef LOGMOD_ROTATING_SINK
+#include <pthread.h>
+
+/**
+ * @brief When a rotating file sink starts a new file
+ */
+struct logmod_rotation_policy {
+    size_t max_bytes; /**< File size to rotate at, 0 for no limit */
+    unsigned long interval_s; /**< Rotate at every multiple of this many
+                                 seconds since the epoch (86400 for daily at
+                                 midnight UTC), 0 for no time limit */
+    unsigned keep; /**< Rotated files kept, `path.1` being the newest */
+};
+
+/**
+ * @brief Rotating file sink state
+ *
+ * Provided by the caller, see logmod_sink_init_rotating().
+ */
+struct logmod_rotation {
+    const char *path; /**< Path of the active file */
+    struct logmod_rotation_policy policy; /**< When files are rotated */
+    size_t written; /**< Bytes in the active file */
+    logmod_uint64 deadline; /**< Timestamp to rotate at, 0 for none */
+    int state; /**< 1 while rotating, 0 otherwise */
+    int joinable; /**< 1 if `helper` has not been joined yet */
+    pthread_t helper; /**< Thread of the last rotation */
+};
+#endif /* LOGMOD_ROTATING_SINK */
+
+#ifdef LOGMOD_DURABLE_SINK
+#include <pthread.h>
+
+/**
+ * @brief Durable file sink state
+ *
+ * Provided by the caller, see logmod_sink_init_durable(). Records are
+ * numbered in the order they are appended to a batch.
+ */
+struct logmod_durable {
+    pthread_mutex_t mutex; /**< Guards the fields below */
+    pthread_cond_t cond; /**< Broadcast when a batch is committed, or when
+                            the batch being gathered is full */
+    char *buffers; /**< Two buffers of `buffer_size` bytes, filled in turn */
+    size_t buffer_size; /**< Size of each buffer */
+    unsigned current; /**< Buffer being filled */
+    size_t filled; /**< Bytes in the batch being filled */
+    int full; /**< If 1, a record is waiting for room in the batch */
+    int committing; /**< If 1, a batch is being gathered or committed */
+    unsigned long max_latency_us; /**< How long a batch waits for more
+                                     records before being committed */
+    unsigned long appended; /**< Number of the last record appended */
+    unsigned long committed; /**< Number of the last record committed */
+    unsigned long batch_first; /**< Number of the first record of the last
+                                  batch committed */
+    int batch_error; /**< errno of the last batch committed, 0 if it is on
+                        disk */
+    unsigned long unread; /**< Records of the last batch committed whose
+                             logging calls haven't read `batch_error` yet,
+                             the next batch waits for them */
+    unsigned long failed; /**< Number of records whose batch failed */
+    int error; /**< errno of the last batch that failed */
+    unsigned long commits; /**< Number of batches committed */
+};
+#endif /* LOGMOD_DURABLE_SINK */
+
 /**
  * @brief ANSI text style values
  */
@@ -198,17 +691,57 @@ typedef logmod_err (*logmod_callback)(const struct logmod_logger *logger,
  * Used to define both const and non-const versions of the logger structure
  * with the same fields.
  *
+ * `hash` is the precomputed hash of `context_id`. The logger table doubles
+ * as an open-addressing index of itself: `bucket` holds the 1-based
+ * position of a logger whose hash probes to this entry, or 0.
+ * `generation` is the one of the logging context when the logger was
+ * created, see @ref LOGMOD_CACHED_LOGGER.
+ * If `identity_cached`, `identity` holds the rendered application and
+ * context IDs of the record prefix, plain then colored, of
+ * `identity_length` bytes each.
+ * `pending` tracks the records the logger wrote to its logfile or binary
+ * stream, held back by its flush policy. Loggers sharing a file each
+ * account for their own records, against their own policy.
+ * Bit `i` of `sink_masks[level]` is set if `sinks[i]` takes records of
+ * that level.
+ * `threshold` is the lowest level any output of the logger takes, or
+ * `(unsigned)-1` if it is disabled.
+ *
+ * Fields are laid out by how often they are accessed: the ones every
+ * logging call checks (`threshold`, and the sink routing down to `sinks`)
+ * come first, followed by the ones lookups compare, then the read-mostly
+ * configuration.
+ * The fields written as records are logged (`pending` and the drop counts)
+ * are kept apart by a cache line on each side, so that writing them doesn't
+ * evict the fields read by threads logging to this logger or its
+ * neighbours in the table.
+ *
  * @param _qualifier Qualifier to apply to mutable fields (const or empty)
  */
 #define __LOGMOD_LOGGER_ATTRS(_qualifier)                                     \
+    _qualifier unsigned threshold;                                            \
+    _qualifier int disabled;                                                  \
+    _qualifier unsigned num_sinks;                                            \
+    _qualifier unsigned char sink_masks[LOGMOD_SINK_LEVELS];                  \
+    struct logmod_sink *_qualifier sinks[LOGMOD_MAX_SINKS];                   \
     const char *context_id;                                                   \
-    _qualifier struct logmod_options options;                                 \
+    _qualifier unsigned long hash;                                            \
+    _qualifier size_t bucket;                                                 \
+    _qualifier unsigned long generation;                                      \
     const long *counter;                                                      \
+    _qualifier struct logmod_options options;                                 \
     _qualifier logmod_callback callback;                                      \
     void *user_data;                                                          \
     const struct logmod_label *_qualifier custom_labels;                      \
     _qualifier size_t num_custom_labels;                                      \
-    _qualifier int disabled
+    _qualifier int identity_cached;                                           \
+    _qualifier size_t identity_length[2];                                     \
+    _qualifier char identity[LOGMOD_IDENTITY_SIZE];                           \
+    _LOGMOD_PADDING(hot_padding, LOGMOD_CACHE_LINE_SIZE);                     \
+    _qualifier struct logmod_flush_state pending;                             \
+    _qualifier unsigned long dropped[LOGMOD_LEVEL_CUSTOM + 1];                \
+    _qualifier unsigned long unreported_drops;                                \
+    _LOGMOD_PADDING(tail_padding, LOGMOD_CACHE_LINE_SIZE)
 
 #define __BLANK
 /**
@@ -232,6 +765,137 @@ struct logmod_logger {
 
 #undef __LOGMOD_LOGGER_ATTRS
 
+/**
+ * @brief Local calendar time cache
+ *
+ * Converted at most once per second and read lock-free by every thread,
+ * guarded by a sequence lock.
+ */
+struct logmod_time_cache {
+    unsigned long generation; /**< Sequence lock, odd while being updated */
+    time_t second; /**< Calendar time the cache has been converted from */
+    struct tm tm; /**< Broken-down local time of `second` */
+    char text[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"]; /**< Pre-rendered `tm`
+                                                     with UTC offset */
+};
+
+/**
+ * @brief Clock source state
+ */
+struct logmod_clock {
+    unsigned source; /**< Selected @ref logmod_clocks */
+    logmod_uint64 base; /**< Wall-clock nanoseconds when source was selected */
+    logmod_uint64 base_ticks; /**< Source reading when source was selected */
+    double ns_per_tick; /**< Calibrated nanoseconds per source tick */
+};
+
+/**
+ * @brief Call site entry of a binary log stream
+ */
+struct logmod_binary_site {
+    const char *fmt; /**< Format string, or NULL if the entry is free */
+    const char *filename; /**< Source filename */
+    const struct logmod_logger *logger; /**< Logger the site logs to */
+    unsigned line; /**< Source line number */
+    unsigned level; /**< Log level */
+    unsigned flags; /**< Logger options the rendered prefix depends on */
+};
+
+/**
+ * @brief Binary log stream
+ *
+ * Each call site (format string, file, line, level and logger) is described
+ * once, the first time it logs. Records then only carry the call site ID,
+ * delta-encoded timestamp and counter, and the raw message arguments. Use
+ * tools/logmod-decode to turn the stream back into text.
+ *
+ * @see logmod_binary_init()
+ */
+struct logmod_binary {
+    FILE *file; /**< File the stream is written to */
+    struct logmod_binary_site *sites; /**< Call site table */
+    unsigned long length; /**< Capacity of the call site table */
+    logmod_uint64 timestamp; /**< Timestamp of the last record */
+    long counter; /**< Counter of the last record */
+    int utc_offset; /**< UTC offset of the last record, in minutes */
+};
+
+#ifdef LOGMOD_ASYNC
+#include <pthread.h>
+
+/**
+ * @brief Payload size of an asynchronous queue slot
+ *
+ * A record takes as many consecutive slots as its header and message body
+ * need. Can be overridden by defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_ASYNC_SLOT_SIZE
+#define LOGMOD_ASYNC_SLOT_SIZE 120
+#endif /* LOGMOD_ASYNC_SLOT_SIZE */
+
+/**
+ * @brief Slot of the asynchronous logging queue
+ *
+ * @see logmod_start_async()
+ */
+struct logmod_async_slot {
+    unsigned long sequence; /**< Queue position the slot is ready for */
+    char data[LOGMOD_ASYNC_SLOT_SIZE]; /**< Record header and/or body */
+};
+
+/**
+ * @brief Bounded multi-producer single-consumer queue of records
+ */
+struct logmod_async_queue {
+    struct logmod_async_slot *slots; /**< Queue storage */
+    unsigned long capacity; /**< Number of slots (a power of two), 0 if
+                               unused */
+    unsigned long head; /**< Next position to be claimed by producers */
+    unsigned long tail; /**< Next position to be taken by the writer (or
+                           dropped to make room) */
+    unsigned long written; /**< Every position before it has been written
+                              or dropped */
+};
+
+/**
+ * @brief Staging buffer of a producing thread
+ *
+ * Provided by the thread, see logmod_async_register().
+ */
+struct logmod_async_staging {
+    struct logmod_async_queue queue; /**< Records of the thread */
+    struct logmod_async_staging *next; /**< Next registered buffer */
+};
+
+/**
+ * @brief Asynchronous logging state
+ *
+ * Records are captured into bounded queues, and written by a dedicated
+ * writer thread. Records at or above the priority level go to their own
+ * lane, which the writer drains first.
+ *
+ * @see logmod_start_async(), logmod_set_priority()
+ */
+struct logmod_async {
+    struct logmod_async_queue queue; /**< Records below the priority level */
+    struct logmod_async_queue priority; /**< Records at or above the priority
+                                           level */
+    unsigned long drops; /**< Drops the writer hasn't reported yet */
+    int sleeping; /**< If 1, the writer is waiting for records */
+    int waiting; /**< Number of threads waiting for the writer to progress */
+    int stopping; /**< If 1, the writer exits once the queue is drained */
+    pthread_t thread; /**< Writer thread */
+    pthread_mutex_t mutex; /**< Guards the condition variables */
+    pthread_cond_t wake; /**< Signaled when records are available */
+    pthread_cond_t progress; /**< Broadcast when records have been written */
+    struct logmod_async_staging *stagings; /**< Registered staging buffers */
+    pthread_key_t key; /**< Staging buffer of the calling thread */
+    struct logmod *logmod; /**< Logging context the writer serves */
+    int error; /**< First error of the flushes run by the writer, reported
+                  by the next logmod_flush() or logmod_stop_async() */
+};
+#endif /* LOGMOD_ASYNC */
+
 /**
  * @brief Main logging context structure
  *
@@ -242,10 +906,43 @@ struct logmod {
     const struct logmod_logger *loggers; /**< Array of loggers */
     const size_t length; /**< Current number of loggers */
     const size_t real_length; /**< Maximum capacity of loggers array */
-    long counter; /**< Global log message counter */
     const struct logmod_options
         default_options; /**< Default options for new loggers */
     logmod_lock lock; /**< Lock function for thread safety */
+    struct logmod_time_cache time_cache; /**< Cached local time */
+    const struct logmod_clock clock; /**< Clock source for timestamps */
+    struct logmod_async *const async; /**< Asynchronous logging state, or NULL
+                                         when logging synchronously */
+    const unsigned long generation; /**< Unique to each logmod_init() call,
+                                       0 once cleaned up */
+    const unsigned overflow; /**< @ref logmod_overflow_policies */
+    const unsigned overflow_level; /**< Level records are kept from, for
+                                      LOGMOD_OVERFLOW_DROP_BELOW */
+    const unsigned priority_level; /**< Level records take the priority lane
+                                      from, LOGMOD_LEVEL_ERROR if 0 */
+    const unsigned sync_level; /**< Level records are written and flushed
+                                  before the logging call returns from,
+                                  LOGMOD_LEVEL_FATAL if 0 */
+    _LOGMOD_PADDING(counter_padding,
+                    LOGMOD_CACHE_LINE_SIZE); /**< Keeps the fields above,
+                                                read by every thread, off
+                                                the cache line of
+                                                `counter` */
+    long counter; /**< Global log message counter (updated atomically) */
+    _LOGMOD_PADDING(tail_padding,
+                    LOGMOD_CACHE_LINE_SIZE
+                        - sizeof(long)); /**< Rest of the cache line */
+};
+
+/**
+ * @brief Logger cached by a call site
+ *
+ * @see LOGMOD_CACHED_LOGGER
+ */
+struct logmod_logger_cache {
+    struct logmod_logger *logger; /**< Cached logger */
+    unsigned long generation; /**< Generation of the logging context when
+                                 `logger` was looked up */
 };
 
 /**
@@ -271,71 +968,223 @@ LOGMOD_API logmod_err logmod_init(struct logmod *logmod,
 LOGMOD_API logmod_err logmod_cleanup(struct logmod *logmod);
 
 /**
- * @brief Set the lock function for thread safety
+ * @brief Flush pending log records
+ *
+ * In asynchronous mode, blocks until every record queued before the call has
+ * been written. Outputs are flushed either way, including records held back
+ * by flush policies. In asynchronous mode, the first flush the writer thread
+ * failed since the previous call is reported as well.
  *
  * @param logmod Pointer to the logging context structure
- * @param lock Lock function to use
  * @return LOGMOD_OK on success, error code on failure
  */
-LOGMOD_API logmod_err logmod_set_lock(struct logmod *logmod, logmod_lock lock);
+LOGMOD_API logmod_err logmod_flush(struct logmod *logmod);
 
+#ifdef LOGMOD_ASYNC
 /**
- * @brief Set default options for all new loggers
+ * @brief Start logging asynchronously
+ *
+ * From then on, logging calls only capture the record (sequence number,
+ * timestamp, level, logger and formatted message body) into a bounded queue
+ * and return, while a writer thread performs all rendering and I/O. Callbacks
+ * are still run by the logging thread. Records at or above the sync level
+ * are queued as well, and the logging thread waits for the writer to have
+ * written and flushed them (see logmod_set_priority()). By default, logging
+ * blocks while the queue is full (see logmod_set_overflow_policy()).
+ * @note Records are truncated to fit the queue, and to LOGMOD_BUFFER_SIZE
  *
  * @param logmod Pointer to the logging context structure
- * @param options Default options to use for new loggers
+ * @param async Asynchronous logging state (must outlive the writer thread)
+ * @param slots Array to store queued records (must be pre-allocated)
+ * @param capacity Number of slots in the array (must be a power of two)
  * @return LOGMOD_OK on success, error code on failure
  */
-LOGMOD_API logmod_err logmod_set_options(struct logmod *logmod,
-                                         struct logmod_options options);
+LOGMOD_API logmod_err logmod_start_async(struct logmod *logmod,
+                                         struct logmod_async *async,
+                                         struct logmod_async_slot slots[],
+                                         unsigned long capacity);
 
 /**
- * @brief Toggle a specific logger from logging (default is true)
+ * @brief Start logging asynchronously, with a priority lane
+ *
+ * Same as logmod_start_async(), except records at or above the priority
+ * level (see logmod_set_priority()) are queued into a lane of their own,
+ * which the writer thread drains before taking each record of the main
+ * queue. They are then written at most one record behind any low-severity
+ * traffic queued before them.
  *
  * @param logmod Pointer to the logging context structure
- * @param context_id The context id of the logger to be enabled or disabled
+ * @param async Asynchronous logging state (must outlive the writer thread)
+ * @param slots Array to store queued records (must be pre-allocated)
+ * @param capacity Number of slots in the array (must be a power of two)
+ * @param priority_slots Array to store queued priority records
+ * @param priority_capacity Number of slots in the priority array (must be
+ * a power of two)
  * @return LOGMOD_OK on success, error code on failure
  */
-LOGMOD_API logmod_err logmod_toggle_logger(struct logmod *logmod,
-                                           const char *const context_id);
+LOGMOD_API logmod_err logmod_start_async_priority(
+    struct logmod *logmod,
+    struct logmod_async *async,
+    struct logmod_async_slot slots[],
+    unsigned long capacity,
+    struct logmod_async_slot priority_slots[],
+    unsigned long priority_capacity);
 
 /**
- * @brief Set user data for a logger
+ * @brief Give the calling thread a staging buffer of its own
  *
- * @param logger Pointer to the logger
- * @param user_data Pointer to user-defined data
+ * The thread's records then go to this buffer, which only it fills, rather
+ * than to the queue shared by every thread (records taking the priority
+ * lane still go to the lane). Producers thus stop contending on the shared
+ * queue. The writer thread collects from every buffer and the shared
+ * queue, taking the record with the lowest sequence number first. The
+ * overflow policy applies to a full buffer as to the shared queue.
+ * @note The buffer must outlive the asynchronous mode, as it is only
+ * forgotten by logmod_stop_async()
+ *
+ * @param logmod Pointer to the logging context structure, logging
+ * asynchronously
+ * @param staging Staging buffer state
+ * @param slots Array to store the thread's queued records
+ * @param capacity Number of slots in the array (must be a power of two)
  * @return LOGMOD_OK on success, error code on failure
  */
-LOGMOD_API logmod_err logmod_logger_set_data(struct logmod_logger *logger,
-                                             void *user_data);
+LOGMOD_API logmod_err logmod_async_register(
+    struct logmod *logmod,
+    struct logmod_async_staging *staging,
+    struct logmod_async_slot slots[],
+    unsigned long capacity);
 
 /**
- * @brief Set callback function and custom labels for a logger
+ * @brief Drain the queue, stop the writer thread and log synchronously again
  *
- * @param logger Pointer to the logger
- * @param custom_labels Array of custom log level labels or NULL
- * @param num_custom_labels Number of custom labels in the array
- * @param callback Callback function for log processing
- * @return LOGMOD_OK on success, error code on failure
+ * Called by logmod_cleanup(). No thread may be logging concurrently.
+ *
+ * @param logmod Pointer to the logging context structure
+ * @return LOGMOD_OK on success, error code on failure (including the first
+ * failed flush of the writer thread not reported by logmod_flush() yet)
  */
-LOGMOD_API logmod_err
-logmod_logger_set_callback(struct logmod_logger *logger,
-                           const struct logmod_label *const custom_labels,
-                           const size_t num_custom_labels,
-                           logmod_callback callback);
+LOGMOD_API logmod_err logmod_stop_async(struct logmod *logmod);
+#endif /* LOGMOD_ASYNC */
 
 /**
- * @brief Set all options for a logger at once
+ * @brief Set the lock function for thread safety
  *
- * @param logger Pointer to the logger
- * @param options Options structure
+ * @param logmod Pointer to the logging context structure
+ * @param lock Lock function to use
  * @return LOGMOD_OK on success, error code on failure
  */
-LOGMOD_API logmod_err logmod_logger_set_options(struct logmod_logger *logger,
-                                                struct logmod_options options);
+LOGMOD_API logmod_err logmod_set_lock(struct logmod *logmod, logmod_lock lock);
 
 /**
- * @brief Set visibility of application ID and context ID in log messages
+ * @brief Set the clock source used to timestamp log entries
+ *
+ * Should be called before logging starts, as monotonic sources are anchored
+ * to the wall-clock (and the TSC calibrated) at this point.
+ *
+ * @param logmod Pointer to the logging context structure
+ * @param source Clock source (@ref logmod_clocks)
+ * @return LOGMOD_OK on success, LOGMOD_BAD_PARAMETER if the source isn't
+ * available on this platform
+ */
+LOGMOD_API logmod_err logmod_set_clock(struct logmod *logmod,
+                                       enum logmod_clocks source);
+
+/**
+ * @brief Set what logging calls do when the asynchronous queue is full
+ *
+ * Dropped records are counted per logger and level (see
+ * logmod_logger_get_dropped()), and the writer thread reports them with a
+ * WARN record of the logger that dropped them.
+ *
+ * @param logmod Pointer to the logging context structure
+ * @param policy Overflow policy (@ref logmod_overflow_policies)
+ * @param level Level records are kept from, for LOGMOD_OVERFLOW_DROP_BELOW
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_set_overflow_policy(
+    struct logmod *logmod, enum logmod_overflow_policies policy,
+    unsigned level);
+
+/**
+ * @brief Set the levels records are prioritized from
+ *
+ * Records at or above `sync_level` are written and flushed (logfile, binary
+ * stream and sinks included) before the logging call returns. In
+ * asynchronous mode, they are still queued, so that they are written in
+ * order by the writer thread, which is waited for. They are never dropped
+ * by the overflow policy. Records at or above `priority_level` take the
+ * priority lane, if any (see logmod_start_async_priority()). Custom levels
+ * are never prioritized, and a level of LOGMOD_LEVEL_CUSTOM disables either.
+ *
+ * @param logmod Pointer to the logging context structure
+ * @param priority_level Level records take the priority lane from, or 0
+ * for LOGMOD_LEVEL_ERROR (the default)
+ * @param sync_level Level records are written synchronously from, or 0 for
+ * LOGMOD_LEVEL_FATAL (the default)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_set_priority(struct logmod *logmod,
+                                          unsigned priority_level,
+                                          unsigned sync_level);
+
+/**
+ * @brief Set default options for all new loggers
+ *
+ * @param logmod Pointer to the logging context structure
+ * @param options Default options to use for new loggers
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_set_options(struct logmod *logmod,
+                                         struct logmod_options options);
+
+/**
+ * @brief Toggle a specific logger from logging (default is true)
+ *
+ * @param logmod Pointer to the logging context structure
+ * @param context_id The context id of the logger to be enabled or disabled
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_toggle_logger(struct logmod *logmod,
+                                           const char *const context_id);
+
+/**
+ * @brief Set user data for a logger
+ *
+ * @param logger Pointer to the logger
+ * @param user_data Pointer to user-defined data
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_data(struct logmod_logger *logger,
+                                             void *user_data);
+
+/**
+ * @brief Set callback function and custom labels for a logger
+ *
+ * @param logger Pointer to the logger
+ * @param custom_labels Array of custom log level labels or NULL
+ * @param num_custom_labels Number of custom labels in the array
+ * @param callback Callback function for log processing
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err
+logmod_logger_set_callback(struct logmod_logger *logger,
+                           const struct logmod_label *const custom_labels,
+                           const size_t num_custom_labels,
+                           logmod_callback callback);
+
+/**
+ * @brief Set all options for a logger at once
+ *
+ * @param logger Pointer to the logger
+ * @param options Options structure
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_options(struct logmod_logger *logger,
+                                                struct logmod_options options);
+
+/**
+ * @brief Set visibility of application ID and context ID in log messages
  *
  * @param logger Pointer to the logger
  * @param show_app_id 1 to show application ID, 0 to hide
@@ -395,6 +1244,317 @@ LOGMOD_API logmod_err logmod_logger_set_logfile(struct logmod_logger *logger,
 LOGMOD_API logmod_err logmod_logger_set_time(struct logmod_logger *logger,
                                              int show_time);
 
+/**
+ * @brief Set how time is rendered for a logger
+ *
+ * @param logger Pointer to the logger
+ * @param time_format Time format (@ref logmod_time_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_time_format(
+    struct logmod_logger *logger, enum logmod_time_formats time_format);
+
+/**
+ * @brief Set whether messages are formatted by the asynchronous writer
+ *
+ * Instead of formatting the message, logging calls only copy the format
+ * string pointer and the raw arguments (strings by value) into the queue.
+ * Messages with conversions that can't be deferred (e.g., `%n`, `%ls`) are
+ * still formatted by the logging thread.
+ * @note Has no effect when logging synchronously, or for loggers with a
+ * callback, which receive the formatted message
+ *
+ * @param logger Pointer to the logger
+ * @param defer_formatting 1 to defer formatting to the writer thread, 0 to
+ * format messages before queueing them
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_defer_formatting(
+    struct logmod_logger *logger, int defer_formatting);
+
+/**
+ * @brief Initialize a binary log stream, and write its header
+ *
+ * @param binary Binary log stream
+ * @param file File to write the stream to (opened in binary mode)
+ * @param sites Array to store call sites (must be pre-allocated). Call sites
+ * that don't fit are described again for every record
+ * @param length Capacity of the sites array
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_binary_init(struct logmod_binary *binary,
+                                         FILE *file,
+                                         struct logmod_binary_site sites[],
+                                         unsigned long length);
+
+/**
+ * @brief Set the binary log stream of a logger
+ *
+ * Records are written to the stream instead of the logfile. Console output
+ * is unaffected. Format strings must remain valid for as long as the
+ * logger logs (string literals always are).
+ * @note Shared by loggers from different threads, the stream is guarded by
+ * the logging context's lock
+ *
+ * @param logger Pointer to the logger
+ * @param binary Binary log stream, or NULL to write text to the logfile
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_binary(struct logmod_logger *logger,
+                                               struct logmod_binary *binary);
+
+/**
+ * @brief Set when a logger's logfile or binary stream is flushed
+ *
+ * Batching records saves a system call per record. Time limits are checked
+ * when the next record is written, and in asynchronous mode also by the
+ * writer thread while it waits for records. Call logmod_flush() before
+ * closing a logfile that may have pending records.
+ *
+ * @param logger Pointer to the logger
+ * @param policy Flush policy, all fields 0 to flush every record
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_logger_set_flush_policy(
+    struct logmod_logger *logger, struct logmod_flush_policy policy);
+
+/**
+ * @brief Initialize a sink
+ *
+ * Other fields (e.g., `flush`) can be set afterwards, before the sink is
+ * attached.
+ *
+ * @param sink Sink to initialize
+ * @param vtable Sink operations
+ * @param data Sink state, passed along as `sink->data`
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init(struct logmod_sink *sink,
+                                       const struct logmod_sink_vtable *vtable,
+                                       void *data,
+                                       unsigned level,
+                                       enum logmod_sink_formats format);
+
+/**
+ * @brief Initialize a sink writing to a file
+ *
+ * The file is flushed as per the sink's flush policy, but never closed.
+ *
+ * @param sink Sink to initialize
+ * @param file File to write to
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_file(struct logmod_sink *sink,
+                                            FILE *file,
+                                            unsigned level,
+                                            enum logmod_sink_formats format);
+
+#ifdef LOGMOD_FD_SINK
+/**
+ * @brief Initialize a sink writing to a file descriptor, bypassing stdio
+ *
+ * Each record is written with a single writev() call, from the rendered
+ * prefix, the message body, and strings too large for the record buffer
+ * in place. On a file opened with O_APPEND, records are thus appended
+ * atomically, even by several processes sharing the file. The descriptor
+ * is never closed.
+ *
+ * @param sink Sink to initialize
+ * @param fd File descriptor to write to
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_fd(struct logmod_sink *sink,
+                                          int fd,
+                                          unsigned level,
+                                          enum logmod_sink_formats format);
+#endif /* LOGMOD_FD_SINK */
+
+#ifdef LOGMOD_MMAP_SINK
+/**
+ * @brief Initialize a sink writing to a memory-mapped file
+ *
+ * Records are appended to the file's current contents without a system
+ * call: each thread reserves space with an atomic offset bump and copies
+ * its rendered record straight into the mapping. The file is preallocated
+ * and mapped one window at a time, a new window being mapped once its
+ * slot's previous window is filled. Once the sink is detached from its
+ * last logger (e.g., by logmod_cleanup()), remaining windows are unmapped
+ * and the file is truncated to the size actually written. The descriptor
+ * is never closed, and the sink must be initialized again to be reused.
+ * If a window can't be mapped (e.g., the disk is full), the records
+ * reserved in it are lost: their space is left as a hole of '\0' bytes,
+ * counted in `map->lost`, and their logging calls return the error.
+ * @note Records are visible to readers of the file as soon as they are
+ * copied, but only reach the disk when the kernel writes the pages back
+ *
+ * @param sink Sink to initialize
+ * @param map Sink state, must outlive the sink
+ * @param fd File descriptor opened for reading and writing
+ * @param window_size Size of each mapping, a multiple of the page size
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_mmap(struct logmod_sink *sink,
+                                            struct logmod_mmap *map,
+                                            int fd,
+                                            size_t window_size,
+                                            unsigned level,
+                                            enum logmod_sink_formats format);
+#endif /* LOGMOD_MMAP_SINK */
+
+#ifdef LOGMOD_URING_SINK
+/**
+ * @brief Initialize a sink writing to a file through io_uring
+ *
+ * Records are copied into the current buffer, which is submitted as a
+ * single write once full or flushed (as per the sink's flush policy), so
+ * that a logging thread never waits on the disk unless every buffer is
+ * still being written. The flush policy defaults to a batched one, rather
+ * than a write per record: records are flushed once the oldest pending one
+ * is 100 milliseconds old, or at once from LOGMOD_LEVEL_ERROR. A thread
+ * waiting for a buffer doesn't hold up the others meanwhile. Writes are
+ * appended at the end of the file, each at
+ * its own offset, so they may complete out of order. A write that fails is
+ * reported by the next call to the sink, which returns LOGMOD_ERRNO with
+ * `errno` set, without logging; the last failure not reported when the
+ * sink is closed is left in `uring->error`. Once the sink is detached from
+ * its last logger, pending writes are waited for and the ring is closed.
+ * The descriptor is never closed.
+ *
+ * Where io_uring is unavailable, or for descriptors that aren't seekable or
+ * were opened with O_APPEND, the sink writes with writev() instead, as
+ * logmod_sink_init_fd() would.
+ *
+ * @param sink Sink to initialize
+ * @param uring Sink state, must outlive the sink
+ * @param fd File descriptor to write to
+ * @param buffers `num_buffers * buffer_size` bytes, must outlive the sink
+ * @param buffer_size Size of each buffer
+ * @param num_buffers Number of buffers, up to @ref LOGMOD_URING_BUFFERS
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_uring(struct logmod_sink *sink,
+                                             struct logmod_uring *uring,
+                                             int fd,
+                                             char *buffers,
+                                             size_t buffer_size,
+                                             unsigned num_buffers,
+                                             unsigned level,
+                                             enum logmod_sink_formats format);
+#endif /* LOGMOD_URING_SINK */
+
+#ifdef LOGMOD_ROTATING_SINK
+/**
+ * @brief Initialize a sink writing to a file that is rotated by size and/or
+ * wall-clock time
+ *
+ * The file is opened for appending, and written to as with
+ * logmod_sink_init_fd(). The write that crosses the size limit or the
+ * interval only starts the rotation: renaming `path` to `path.1`, and so on
+ * up to `path.keep`, deleting the oldest file and opening a new one happen
+ * on a helper thread, whatever the flush policy. The new file then replaces
+ * the old one behind the same descriptor with dup2(), atomically: logging
+ * threads (or the writer thread) keep writing to the old file meanwhile,
+ * and never wait for the rotation. The file is closed once the sink is
+ * detached from its last logger, after the rotation in progress if any.
+ *
+ * @param sink Sink to initialize
+ * @param rotation Sink state, must outlive the sink
+ * @param path Path of the active file, must outlive the sink
+ * @param policy When files are rotated
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_rotating(
+    struct logmod_sink *sink,
+    struct logmod_rotation *rotation,
+    const char *path,
+    struct logmod_rotation_policy policy,
+    unsigned level,
+    enum logmod_sink_formats format);
+#endif /* LOGMOD_ROTATING_SINK */
+
+#ifdef LOGMOD_DURABLE_SINK
+/**
+ * @brief Initialize a sink writing to a file descriptor, whose logging calls
+ * return once their record is on disk
+ *
+ * Records are gathered into a batch, which is committed with a single
+ * write() and fdatasync() by one of the waiting threads (group commit):
+ * records logged concurrently share the cost of a disk flush, and records
+ * logged while a batch is being committed make up the next one. The thread
+ * committing a batch waits up to `max_latency_us` for more records to join
+ * it, or until it is full, trading latency for throughput. A record larger
+ * than a buffer is written and committed on its own. Logging calls return
+ * LOGMOD_ERRNO with `errno` set, without logging, if their batch couldn't
+ * be committed. The descriptor is never closed.
+ * @note In asynchronous mode, the writer thread would wait for each record
+ * in turn: make durable records synchronous instead (see
+ * logmod_set_priority())
+ *
+ * @param sink Sink to initialize
+ * @param durable Sink state, must outlive the sink
+ * @param fd File descriptor to write to
+ * @param buffers `2 * buffer_size` bytes, must outlive the sink
+ * @param buffer_size Size of each of the two buffers
+ * @param max_latency_us How long a batch waits for more records, 0 to
+ * commit as soon as the previous batch is
+ * @param level Minimum level written to the sink
+ * @param format Rendering (@ref logmod_sink_formats)
+ * @return LOGMOD_OK on success, error code on failure
+ */
+LOGMOD_API logmod_err logmod_sink_init_durable(
+    struct logmod_sink *sink,
+    struct logmod_durable *durable,
+    int fd,
+    char *buffers,
+    size_t buffer_size,
+    unsigned long max_latency_us,
+    unsigned level,
+    enum logmod_sink_formats format);
+#endif /* LOGMOD_DURABLE_SINK */
+
+/**
+ * @brief Attach a sink to a logger
+ *
+ * The sink takes records at or above its own level, whether or not they
+ * pass the logger's level (which only applies to the console and logfile).
+ * A logger's callback returning LOGMOD_OK skips its sinks as well.
+ * @note A sink attached to several loggers relies on the lock function to
+ * exclude all of them, see @ref logmod_sink
+ *
+ * @param logger Pointer to the logger
+ * @param sink Initialized sink, which must outlive its attachment
+ * @return LOGMOD_OK on success, LOGMOD_BAD_PARAMETER if the logger already
+ * has LOGMOD_MAX_SINKS sinks, or has this sink attached
+ */
+LOGMOD_API logmod_err logmod_logger_add_sink(struct logmod_logger *logger,
+                                             struct logmod_sink *sink);
+
+/**
+ * @brief Detach a sink from a logger
+ *
+ * Pending records are flushed, and the sink is closed if no other logger
+ * has it attached. logmod_cleanup() detaches every sink.
+ *
+ * @param logger Pointer to the logger
+ * @param sink Sink attached to the logger
+ * @return LOGMOD_OK on success, LOGMOD_BAD_PARAMETER if the sink isn't
+ * attached to the logger
+ */
+LOGMOD_API logmod_err logmod_logger_remove_sink(struct logmod_logger *logger,
+                                                struct logmod_sink *sink);
+
 /**
  * @brief Set counter display for a logger
  *
@@ -408,6 +1568,9 @@ LOGMOD_API logmod_err logmod_logger_set_counter(struct logmod_logger *logger,
 /**
  * @brief Get or create a logger by context ID
  *
+ * Lookup is a hash index probe. Existing loggers are found without taking
+ * the lock (if atomics are available), only creating a logger does.
+ *
  * @param logmod Pointer to the logging context
  * @param context_id Context identifier string
  * @return Pointer to the logger, or NULL if the table is full
@@ -443,6 +1606,44 @@ LOGMOD_API long logmod_logger_get_level(const struct logmod_logger *logger,
  */
 LOGMOD_API long logmod_logger_get_counter(const struct logmod_logger *logger);
 
+/**
+ * @brief Get the number of records of a level a logger dropped because the
+ * asynchronous queue was full
+ *
+ * @param logger Pointer to the logger
+ * @param level Log level, custom levels being counted together
+ * @return Number of dropped records, or 0 if logger is NULL
+ */
+LOGMOD_API unsigned long logmod_logger_get_dropped(
+    const struct logmod_logger *logger, unsigned level);
+
+/**
+ * @brief Check if a message of a given level would be accepted by a logger
+ *
+ * This is the inline fast-path gate used by the logging macros, so that
+ * messages from disabled loggers or below the logger's level never reach
+ * the library (no timestamp, label lookup or locking).
+ * @note `_logger` may be evaluated more than once
+ *
+ * @param _logger The logger instance or NULL for default logger
+ * @param _level Log level value (e.g., LOGMOD_LEVEL_INFO)
+ */
+#define LOGMOD_SHOULD_LOG(_logger, _level)                                    \
+    (!(_logger)                                                               \
+     || (unsigned)(_level)                                                    \
+            >= ((const struct logmod_logger *)(_logger))->threshold)
+
+/**
+ * @brief Check if a log level is compiled in
+ *
+ * Constant expression used by the logging macros to strip messages below
+ * @ref LOGMOD_COMPILE_MIN_LEVEL
+ *
+ * @param _level Log level value (e.g., LOGMOD_LEVEL_INFO)
+ */
+#define LOGMOD_LEVEL_COMPILED(_level)                                         \
+    ((int)(_level) >= (int)(LOGMOD_COMPILE_MIN_LEVEL))
+
 /**
  * @brief Log a message (C89 compatible version)
  *
@@ -452,8 +1653,11 @@ LOGMOD_API long logmod_logger_get_counter(const struct logmod_logger *logger);
  * @param num_params Number of arguments in the format string
  */
 #define logmod_nlog(_level, _logger, _parenthesized_params, num_params)       \
-    _logmod_log(_logger, __LINE__, __FILE__, LOGMOD_LEVEL_##_level,           \
-                LOGMOD_SPREAD_TUPLE_##num_params _parenthesized_params)
+    (LOGMOD_LEVEL_COMPILED(LOGMOD_LEVEL_##_level)                             \
+             && LOGMOD_SHOULD_LOG(_logger, LOGMOD_LEVEL_##_level)             \
+         ? _logmod_log(_logger, __LINE__, __FILE__, LOGMOD_LEVEL_##_level,    \
+                       LOGMOD_SPREAD_TUPLE_##num_params _parenthesized_params) \
+         : LOGMOD_OK_SKIPPED)
 
 #if __STDC_VERSION__ && __STDC_VERSION__ >= 199901L
 /**
@@ -467,7 +1671,9 @@ LOGMOD_API long logmod_logger_get_counter(const struct logmod_logger *logger);
  * @param ... Additional format arguments
  */
 #define _logmod_log_permissive(_level, _logger, _line, _file, _fmt, ...)      \
-    _logmod_log(_logger, _line, _file, _level, _fmt "%s", __VA_ARGS__)
+    (LOGMOD_LEVEL_COMPILED(_level) && LOGMOD_SHOULD_LOG(_logger, _level)      \
+         ? _logmod_log(_logger, _line, _file, _level, _fmt "%s", __VA_ARGS__) \
+         : LOGMOD_OK_SKIPPED)
 
 /**
  * @brief Log a message with specified level (C99 version with variadic macro
@@ -487,6 +1693,142 @@ LOGMOD_API long logmod_logger_get_counter(const struct logmod_logger *logger);
 #define logmod_log logmod_nlog
 #endif /* __STDC_VERSION__ */
 
+/**
+ * @brief Atomic operations used by the lock-free paths
+ *
+ * GCC/Clang builtins (available in C89 mode as well), or C11 atomics.
+ * LOGMOD_ATOMICS is left undefined when neither is available, in which case
+ * the user-supplied @ref logmod_lock is used instead.
+ *
+ * @param _type Type of the object pointed to by `_ptr`
+ */
+#if (defined(__GNUC__)                                                        \
+     && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))             \
+    || defined(__clang__)
+#define LOGMOD_ATOMICS
+#define LOGMOD_ATOMIC_LOAD(_type, _ptr)                                       \
+    __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define LOGMOD_ATOMIC_STORE(_type, _ptr, _value)                              \
+    __atomic_store_n((_ptr), (_value), __ATOMIC_RELEASE)
+#define LOGMOD_ATOMIC_FETCH_ADD(_type, _ptr, _value)                          \
+    __atomic_fetch_add((_ptr), (_value), __ATOMIC_ACQ_REL)
+#define LOGMOD_ATOMIC_CAS(_type, _ptr, _expected, _desired)                   \
+    __atomic_compare_exchange_n((_ptr), (_expected), (_desired), 0,           \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define LOGMOD_ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L                \
+    && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define LOGMOD_ATOMICS
+#define LOGMOD_ATOMIC_LOAD(_type, _ptr)                                       \
+    atomic_load_explicit((_Atomic(_type) *)(_ptr), memory_order_acquire)
+#define LOGMOD_ATOMIC_STORE(_type, _ptr, _value)                              \
+    atomic_store_explicit((_Atomic(_type) *)(_ptr), (_value),                 \
+                          memory_order_release)
+#define LOGMOD_ATOMIC_FETCH_ADD(_type, _ptr, _value)                          \
+    atomic_fetch_add_explicit((_Atomic(_type) *)(_ptr), (_value),             \
+                              memory_order_acq_rel)
+#define LOGMOD_ATOMIC_CAS(_type, _ptr, _expected, _desired)                   \
+    atomic_compare_exchange_strong_explicit(                                  \
+        (_Atomic(_type) *)(_ptr), (_expected), (_desired),                    \
+        memory_order_acq_rel, memory_order_acquire)
+#define LOGMOD_ATOMIC_FENCE() atomic_thread_fence(memory_order_seq_cst)
+#endif
+
+/**
+ * @brief Get a logger through a per call site cache
+ *
+ * The cached logger is reused as long as both the cache and the logger
+ * belong to the current generation of the logging context, and is
+ * otherwise looked up again. Reinitializing or cleaning up the context thus
+ * invalidates every cache.
+ * @note `_logmod` and `_cache` may be evaluated more than once
+ *
+ * @param _logmod Pointer to the logging context
+ * @param _context_id Context identifier string, the same on every call
+ * @param _cache Pointer to the call site's @ref logmod_logger_cache
+ */
+#ifdef LOGMOD_ATOMICS
+/* the generation is published after the logger, see
+   _logmod_get_logger_cached() */
+#define _LOGMOD_CACHE_GENERATION(_cache)                                      \
+    LOGMOD_ATOMIC_LOAD(unsigned long, &(_cache)->generation)
+#else
+#define _LOGMOD_CACHE_GENERATION(_cache) ((_cache)->generation)
+#endif
+#define LOGMOD_CACHED_LOGGER(_logmod, _context_id, _cache)                    \
+    ((_logmod)->generation                                                    \
+             && _LOGMOD_CACHE_GENERATION(_cache) == (_logmod)->generation     \
+             && (_cache)->logger->generation == (_logmod)->generation         \
+         ? (_cache)->logger                                                   \
+         : _logmod_get_logger_cached((_logmod), (_context_id), (_cache)))
+
+/**
+ * @brief Log a message to a logger by context ID (C89 compatible version)
+ *
+ * The logger is looked up on the first call only, and cached by the call
+ * site. Falls back to the default logger if it can't be created. This is a
+ * statement, the logging result is discarded.
+ *
+ * @param _level Log level (without LOGMOD_LEVEL_ prefix)
+ * @param _logmod Pointer to the logging context
+ * @param _context_id Context identifier string
+ * @param _parenthesized_params Format and arguments in parentheses
+ * @param num_params Number of arguments in the format string
+ */
+#define logmod_nlog_context(_level, _logmod, _context_id,                     \
+                            _parenthesized_params, num_params)                \
+    do {                                                                      \
+        static struct logmod_logger_cache _logmod_cache;                      \
+        if (LOGMOD_LEVEL_COMPILED(LOGMOD_LEVEL_##_level)) {                   \
+            struct logmod_logger *_logmod_logger =                            \
+                LOGMOD_CACHED_LOGGER(_logmod, _context_id, &_logmod_cache);   \
+            (void)logmod_nlog(_level, _logmod_logger, _parenthesized_params,  \
+                              num_params);                                    \
+        }                                                                     \
+    } while (0)
+
+#if __STDC_VERSION__ && __STDC_VERSION__ >= 199901L
+/**
+ * @brief Log a message to a logger by context ID (C99 version with variadic
+ * macro support)
+ *
+ * @see logmod_nlog_context()
+ *
+ * @param _level Log level (e.g., INFO, DEBUG, ERROR)
+ * @param _logmod Pointer to the logging context
+ * @param _context_id Context identifier string
+ * @param ... Format string followed by format arguments
+ */
+#define logmod_log_context(_level, _logmod, _context_id, ...)                 \
+    do {                                                                      \
+        static struct logmod_logger_cache _logmod_cache;                      \
+        if (LOGMOD_LEVEL_COMPILED(LOGMOD_LEVEL_##_level)) {                   \
+            struct logmod_logger *_logmod_logger =                            \
+                LOGMOD_CACHED_LOGGER(_logmod, _context_id, &_logmod_cache);   \
+            (void)logmod_log(_level, _logmod_logger, __VA_ARGS__);            \
+        }                                                                     \
+    } while (0)
+#else
+/**
+ * @brief Alias to logmod_nlog_context for C89 compatibility
+ */
+#define logmod_log_context logmod_nlog_context
+#endif /* __STDC_VERSION__ */
+
+/**
+ * @brief Look a logger up, and store it in a call site cache
+ *
+ * @param logmod Pointer to the logging context
+ * @param context_id Context identifier string
+ * @param cache Call site cache, left untouched if the logger isn't found
+ * @return Pointer to the logger, or NULL if the table is full
+ */
+LOGMOD_API struct logmod_logger *_logmod_get_logger_cached(
+    struct logmod *logmod,
+    const char *const context_id,
+    struct logmod_logger_cache *cache);
+
 /**
  * @brief Internal logging implementation function
  *
@@ -609,9 +1951,55 @@ LOGMOD_API logmod_err _logmod_log(const struct logmod_logger *logger,
 #include <stddef.h>
 #include <string.h>
 #include <time.h>
+#ifdef LOGMOD_FD_SINK
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif /* LOGMOD_FD_SINK */
+#ifdef LOGMOD_MMAP_SINK
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* LOGMOD_MMAP_SINK */
+#ifdef LOGMOD_ROTATING_SINK
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif /* LOGMOD_ROTATING_SINK */
+#ifdef LOGMOD_URING_SINK
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif /* LOGMOD_URING_SINK */
 
 #include "logmod.h"
 
+/**
+ * @brief vsnprintf() implementation used for rendering log records
+ *
+ * vsnprintf() is C99, but it is available in the C library of every
+ * supported platform, so declare it ourselves for C89 builds. Can be
+ * overridden by defining this macro before including logmod.h
+ */
+#ifndef LOGMOD_VSNPRINTF
+#define LOGMOD_VSNPRINTF vsnprintf
+#if !(defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)               \
+    && !defined(__cplusplus) && !defined(_MSC_VER)
+extern int vsnprintf(char *, size_t, const char *, va_list);
+#endif
+#endif /* LOGMOD_VSNPRINTF */
+
+/** @brief Portable va_copy() */
+#if defined(va_copy)
+#define LOGMOD_VA_COPY va_copy
+#elif defined(__va_copy)
+#define LOGMOD_VA_COPY __va_copy
+#else
+#define LOGMOD_VA_COPY(_dest, _src) memcpy(&(_dest), &(_src), sizeof(va_list))
+#endif
+
 static const struct logmod_label default_labels[__LOGMOD_LEVEL_MAX] = {
     /*[LOGMOD_LEVEL_TRACE]:*/
     { "TRACE", LOGMOD_LABEL_COLOR(REGULAR, BACKGROUND_INTENSITY, BLUE), 0 },
@@ -666,6 +2054,64 @@ _logmod_lock_noop(const struct logmod_logger *_, int __)
     (void)__;
 }
 
+/**
+ * @brief Recompute the minimum level a message must have to be handled
+ *
+ * Must be called whenever `disabled`, `options.level`, `callback`,
+ * `options.callback_all_levels` or `sinks` changes, as it is read by the
+ * @ref LOGMOD_SHOULD_LOG fast-path gate.
+ */
+static void
+_logmod_logger_update_threshold(struct logmod_mut_logger *mut_logger)
+{
+    if (mut_logger->disabled)
+        mut_logger->threshold = (unsigned)-1;
+    else if (mut_logger->callback && mut_logger->options.callback_all_levels)
+        mut_logger->threshold = 0;
+    else {
+        unsigned i;
+        mut_logger->threshold = mut_logger->options.level;
+        for (i = 0; i < mut_logger->num_sinks; ++i) {
+            if (mut_logger->sinks[i]->level < mut_logger->threshold)
+                mut_logger->threshold = mut_logger->sinks[i]->level;
+        }
+    }
+}
+
+/** @brief Mask of the logger's sinks that take records of `level` */
+static unsigned
+_logmod_sink_mask(const struct logmod_logger *logger, const unsigned level)
+{
+    unsigned i, mask = 0;
+    for (i = 0; i < logger->num_sinks; ++i) {
+        if (level >= logger->sinks[i]->level) mask |= 1u << i;
+    }
+    return mask;
+}
+
+/** @brief Mask of the logger's sinks that take records of `_level` */
+#define _LOGMOD_SINK_MASK(_logger, _level)                                    \
+    ((_level) < LOGMOD_SINK_LEVELS ? (unsigned)(_logger)->sink_masks[_level]  \
+                                   : _logmod_sink_mask(_logger, _level))
+
+/** @brief Precompute sink routing, must be called whenever `sinks` changes */
+static void
+_logmod_logger_update_sinks(struct logmod_mut_logger *mut_logger)
+{
+    unsigned level;
+    for (level = 0; level < LOGMOD_SINK_LEVELS; ++level) {
+        mut_logger->sink_masks[level] = (unsigned char)_logmod_sink_mask(
+            (const struct logmod_logger *)mut_logger, level);
+    }
+    _logmod_logger_update_threshold(mut_logger);
+}
+
+static void _logmod_logger_update_identity(
+    struct logmod_mut_logger *mut_logger);
+
+/** last generation handed out by logmod_init() */
+static unsigned long g_generation;
+
 LOGMOD_API logmod_err
 logmod_init(struct logmod *logmod,
             const char *const application_id,
@@ -673,6 +2119,7 @@ logmod_init(struct logmod *logmod,
             unsigned length)
 {
     size_t *mut_real_length = (size_t *)&logmod->real_length;
+    unsigned long *mut_generation = (unsigned long *)&logmod->generation;
     LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
     LOGMOD_EXPECT(application_id && *application_id, LOGMOD_BAD_PARAMETER);
     LOGMOD_EXPECT(table != NULL, LOGMOD_BAD_PARAMETER);
@@ -683,12 +2130,28 @@ logmod_init(struct logmod *logmod,
     logmod->loggers = table;
     *mut_real_length = length;
     logmod->lock = _logmod_lock_noop;
+#ifdef LOGMOD_ATOMICS
+    *mut_generation = LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &g_generation, 1)
+                      + 1;
+#else
+    *mut_generation = ++g_generation;
+#endif
     return LOGMOD_OK;
 }
 
 LOGMOD_API logmod_err
 logmod_cleanup(struct logmod *logmod)
 {
+    size_t i;
+#ifdef LOGMOD_ASYNC
+    if (logmod->async) logmod_stop_async(logmod);
+#endif
+    for (i = 0; i < logmod->length; ++i) {
+        struct logmod_logger *logger =
+            (struct logmod_logger *)&logmod->loggers[i];
+        while (logger->num_sinks)
+            logmod_logger_remove_sink(logger, logger->sinks[0]);
+    }
     memset((void *)logmod->loggers, 0,
            logmod->real_length * sizeof *logmod->loggers);
     memset(logmod, 0, sizeof *logmod);
@@ -703,6 +2166,35 @@ logmod_set_lock(struct logmod *logmod, logmod_lock lock)
     return LOGMOD_OK;
 }
 
+LOGMOD_API logmod_err
+logmod_set_overflow_policy(struct logmod *logmod,
+                           enum logmod_overflow_policies policy,
+                           unsigned level)
+{
+    unsigned *mut_overflow = (unsigned *)&logmod->overflow;
+    unsigned *mut_overflow_level = (unsigned *)&logmod->overflow_level;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(policy <= LOGMOD_OVERFLOW_DROP_BELOW, LOGMOD_BAD_PARAMETER);
+    *mut_overflow = policy;
+    *mut_overflow_level = level;
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_set_priority(struct logmod *logmod,
+                    unsigned priority_level,
+                    unsigned sync_level)
+{
+    unsigned *mut_priority_level = (unsigned *)&logmod->priority_level;
+    unsigned *mut_sync_level = (unsigned *)&logmod->sync_level;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(priority_level <= LOGMOD_LEVEL_CUSTOM, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(sync_level <= LOGMOD_LEVEL_CUSTOM, LOGMOD_BAD_PARAMETER);
+    *mut_priority_level = priority_level;
+    *mut_sync_level = sync_level;
+    return LOGMOD_OK;
+}
+
 LOGMOD_API logmod_err
 logmod_set_options(struct logmod *logmod, struct logmod_options options)
 {
@@ -720,6 +2212,7 @@ logmod_toggle_logger(struct logmod *logmod, const char *const context_id)
         (struct logmod_mut_logger *)logmod_get_logger(logmod, context_id);
     LOGMOD_EXPECT(mut_logger != NULL, LOGMOD_BAD_PARAMETER);
     mut_logger->disabled = !mut_logger->disabled;
+    _logmod_logger_update_threshold(mut_logger);
     return LOGMOD_OK;
 }
 
@@ -732,6 +2225,7 @@ logmod_logger_set_id_visibility(struct logmod_logger *logger,
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
     mut_logger->options.show_application_id = show_app_id;
     mut_logger->options.hide_context_id = !show_context_id;
+    _logmod_logger_update_identity(mut_logger);
     return LOGMOD_OK;
 }
 
@@ -758,6 +2252,7 @@ logmod_logger_set_callback(struct logmod_logger *logger,
         mut_logger->custom_labels = custom_labels;
         mut_logger->num_custom_labels = num_custom_labels;
     }
+    _logmod_logger_update_threshold(mut_logger);
     return LOGMOD_OK;
 }
 
@@ -768,6 +2263,8 @@ logmod_logger_set_options(struct logmod_logger *logger,
     struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
     mut_logger->options = options;
+    _logmod_logger_update_threshold(mut_logger);
+    _logmod_logger_update_identity(mut_logger);
     return LOGMOD_OK;
 }
 
@@ -795,6 +2292,7 @@ logmod_logger_set_level(struct logmod_logger *logger, unsigned level)
     struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
     mut_logger->options.level = level;
+    _logmod_logger_update_threshold(mut_logger);
     return LOGMOD_OK;
 }
 
@@ -802,8 +2300,14 @@ LOGMOD_API logmod_err
 logmod_logger_set_logfile(struct logmod_logger *logger, FILE *logfile)
 {
     struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod *logmod;
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    logmod = LOGMOD_FROM_LOGGER(logger);
+    /* read by the writer thread's flush timer */
+    logmod->lock(logger, 1);
     mut_logger->options.logfile = logfile;
+    memset(&mut_logger->pending, 0, sizeof mut_logger->pending);
+    logmod->lock(logger, 0);
     return LOGMOD_OK;
 }
 
@@ -817,269 +2321,4452 @@ logmod_logger_set_time(struct logmod_logger *logger, int show_time)
 }
 
 LOGMOD_API logmod_err
-logmod_logger_set_counter(struct logmod_logger *logger, int show_counter)
+logmod_logger_set_time_format(struct logmod_logger *logger,
+                              enum logmod_time_formats time_format)
 {
     struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
-    mut_logger->options.hide_counter = !show_counter;
+    LOGMOD_EXPECT(time_format <= LOGMOD_TIME_ISO8601, LOGMOD_BAD_PARAMETER);
+    mut_logger->options.time_format = time_format;
     return LOGMOD_OK;
 }
 
-LOGMOD_API const struct logmod_label *
-logmod_logger_get_label(const struct logmod_logger *logger,
-                        const unsigned level)
+LOGMOD_API logmod_err
+logmod_logger_set_defer_formatting(struct logmod_logger *logger,
+                                   int defer_formatting)
 {
-    static const struct logmod_label unknown_label = {
-        "#UNKNOWN LABEL!!",
-        LOGMOD_LABEL_COLOR(STRIKETHROUGH, BACKGROUND_INTENSITY, YELLOW), 1
-    };
-    if (level < LOGMOD_LEVEL_CUSTOM) {
-        return &default_labels[level];
-    }
-    if (logger && level >= LOGMOD_LEVEL_CUSTOM
-        && level < (LOGMOD_LEVEL_CUSTOM + logger->num_custom_labels))
-    {
-        return &logger->custom_labels[level - LOGMOD_LEVEL_CUSTOM];
-    }
-    logmod_nlog(ERROR, NULL,
-                ("Invalid log level %u for logger %s", level,
-                 logger ? logger->context_id : "NULL"),
-                2);
-    return &unknown_label;
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    mut_logger->options.defer_formatting = defer_formatting;
+    return LOGMOD_OK;
 }
 
-LOGMOD_API long
-logmod_logger_get_level(const struct logmod_logger *logger,
-                        const char *const label)
+LOGMOD_API logmod_err
+logmod_logger_set_binary(struct logmod_logger *logger,
+                         struct logmod_binary *binary)
 {
-    size_t i;
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod *logmod;
     LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
-    LOGMOD_EXPECT(label != NULL, LOGMOD_BAD_PARAMETER);
-    for (i = 0; i < __LOGMOD_LEVEL_MAX; ++i) {
-        if (strcmp(label, default_labels[i].name) == 0) {
-            return (long)i;
-        }
-    }
-    for (i = 0; i < logger->num_custom_labels; ++i) {
-        if (strcmp(label, logger->custom_labels[i].name) == 0) {
-            return (long)(i + LOGMOD_LEVEL_CUSTOM);
-        }
-    }
-    return LOGMOD_BAD_PARAMETER;
+    logmod = LOGMOD_FROM_LOGGER(logger);
+    logmod->lock(logger, 1);
+    mut_logger->options.binary = binary;
+    memset(&mut_logger->pending, 0, sizeof mut_logger->pending);
+    logmod->lock(logger, 0);
+    return LOGMOD_OK;
 }
 
-LOGMOD_API long
-logmod_logger_get_counter(const struct logmod_logger *logger)
+LOGMOD_API logmod_err
+logmod_logger_set_flush_policy(struct logmod_logger *logger,
+                               struct logmod_flush_policy policy)
 {
-    struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
-    long counter;
-    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod *logmod;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    logmod = LOGMOD_FROM_LOGGER(logger);
     logmod->lock(logger, 1);
-    counter = logmod->counter;
+    mut_logger->options.flush = policy;
     logmod->lock(logger, 0);
-    return counter;
+    return LOGMOD_OK;
 }
 
-LOGMOD_API struct logmod_logger *
-logmod_get_logger(struct logmod *logmod, const char *const context_id)
+static logmod_err
+_logmod_file_sink_write(struct logmod_sink *sink,
+                        const struct logmod_info *info,
+                        const char *line,
+                        size_t length)
 {
-    size_t i;
-    _LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER, NULL);
-    _LOGMOD_EXPECT(logmod->loggers != NULL, LOGMOD_BAD_PARAMETER, NULL);
-    _LOGMOD_EXPECT(context_id != NULL, LOGMOD_BAD_PARAMETER, NULL);
-    logmod->lock(NULL, 1);
-    for (i = 0; i < logmod->length; ++i) {
-        if (0 == strcmp(logmod->loggers[i].context_id, context_id)) {
-            struct logmod_logger *logger =
-                (struct logmod_logger *)&logmod->loggers[i];
-            logmod->lock(logger, 0);
-            return logger;
-        }
-    }
-    if (logmod->length < logmod->real_length) {
-        size_t *mut_length = (size_t *)&logmod->length;
-        struct logmod_mut_logger *mut_logger =
-            (struct logmod_mut_logger *)&logmod->loggers[logmod->length];
-        memset(mut_logger, 0, sizeof *mut_logger);
-        mut_logger->context_id = context_id;
-        mut_logger->counter = &logmod->counter;
-        mut_logger->options = logmod->default_options;
-        ++*mut_length;
-        logmod->lock((struct logmod_logger *)mut_logger, 0);
-        return (struct logmod_logger *)mut_logger;
-    }
-    logmod->lock(NULL, 0);
-    return NULL;
+    (void)info;
+    LOGMOD_EXPECT(fwrite(line, 1, length, (FILE *)sink->data) == length,
+                  LOGMOD_ERRNO);
+    return LOGMOD_OK;
 }
 
 static logmod_err
-_logmod_print(const struct logmod_logger *logger,
-              const struct logmod_info *info,
-              const char *fmt,
-              va_list args,
-              const int color,
-              FILE *output)
+_logmod_file_sink_flush(struct logmod_sink *sink)
 {
-    if (!logger->options.hide_counter) {
-        LOGMOD_EXPECT(fprintf(output,
-                              LMT(color, BOLD, FOREGROUND, WHITE, "%-3ld "),
-                              logmod_logger_get_counter(logger))
-                          >= 0,
-                      LOGMOD_ERRNO);
-    }
-    if (!logger->options.suppress_time) {
-        LOGMOD_EXPECT(
-            fprintf(output,
-                    LMT(color, UNDERLINE, FOREGROUND, WHITE, "%02d:%02d:%02d"),
-                    info->time.tm_hour, info->time.tm_min, info->time.tm_sec)
-                >= 0,
-            LOGMOD_ERRNO);
-        LOGMOD_EXPECT(putc(' ', output) != EOF, LOGMOD_ERRNO);
-    }
-    if (logger->options.show_application_id) {
-        const struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
-        LOGMOD_EXPECT(fprintf(output,
-                              LMT(color, BOLD, FOREGROUND, BLACK, "%s"),
-                              logmod->application_id)
-                          >= 0,
-                      LOGMOD_ERRNO);
-        LOGMOD_EXPECT(fputs(LMT(color, BOLD, FOREGROUND, BLACK, " » "), output)
-                          != EOF,
-                      LOGMOD_ERRNO);
+    LOGMOD_EXPECT(fflush((FILE *)sink->data) != EOF, LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+
+static const struct logmod_sink_vtable g_file_sink = {
+    _logmod_file_sink_write, _logmod_file_sink_flush, NULL, NULL
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init(struct logmod_sink *sink,
+                 const struct logmod_sink_vtable *vtable,
+                 void *data,
+                 unsigned level,
+                 enum logmod_sink_formats format)
+{
+    LOGMOD_EXPECT(sink != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(vtable != NULL && vtable->write != NULL,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(format <= LOGMOD_SINK_STRUCTURED, LOGMOD_BAD_PARAMETER);
+    memset(sink, 0, sizeof *sink);
+    sink->vtable = vtable;
+    sink->data = data;
+    sink->level = level;
+    sink->format = format;
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_sink_init_file(struct logmod_sink *sink,
+                      FILE *file,
+                      unsigned level,
+                      enum logmod_sink_formats format)
+{
+    LOGMOD_EXPECT(file != NULL, LOGMOD_BAD_PARAMETER);
+    return logmod_sink_init(sink, &g_file_sink, file, level, format);
+}
+
+#ifdef LOGMOD_FD_SINK
+static logmod_err
+_logmod_fd_sink_writev(struct logmod_sink *sink,
+                       const struct logmod_info *info,
+                       const struct logmod_segment segments[],
+                       unsigned count)
+{
+    struct iovec iov[LOGMOD_MAX_SEGMENTS], *first = iov;
+    unsigned i;
+    (void)info;
+    for (i = 0; i < count; ++i) {
+        iov[i].iov_base = (void *)segments[i].data;
+        iov[i].iov_len = segments[i].length;
     }
-    if (!logger->options.hide_context_id) {
-        LOGMOD_EXPECT(fprintf(output,
-                              LMT(color, BOLD, FOREGROUND, WHITE, "%s"),
-                              logger->context_id)
-                          >= 0,
-                      LOGMOD_ERRNO);
-        LOGMOD_EXPECT(fputs(LMT(color, BOLD, FOREGROUND, WHITE, " » "), output)
-                          != EOF,
-                      LOGMOD_ERRNO);
+    while (count) { /* resume partial writes */
+        const ssize_t written = writev(sink->fd, first, (int)count);
+        size_t left = (size_t)written;
+        if (written < 0) {
+            /* not logged, as logging the failure could go through this
+               sink, and errno must reach the caller intact */
+            if (errno != EINTR) return LOGMOD_ERRNO;
+            continue;
+        }
+        for (; count && left >= first->iov_len; ++first, --count)
+            left -= first->iov_len;
+        if (count) {
+            first->iov_base = (char *)first->iov_base + left;
+            first->iov_len -= left;
+        }
     }
-    if (color) {
-        LOGMOD_EXPECT(fprintf(output,
-                              LME("%s", "%s", "%s", "%s") " " LMS(
-                                  REGULAR, FOREGROUND, YELLOW,
-                                  "%s") LMS(BOLD, FOREGROUND, WHITE, ":")
-                                  LMS(REGULAR, FOREGROUND, WHITE, "%d") ": ",
-                              info->label->style, info->label->visibility,
-                              info->label->color, info->label->name,
-                              info->filename, info->line)
-                          >= 0,
-                      LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+
+static logmod_err
+_logmod_fd_sink_write(struct logmod_sink *sink,
+                      const struct logmod_info *info,
+                      const char *line,
+                      size_t length)
+{
+    struct logmod_segment segment;
+    segment.data = line;
+    segment.length = length;
+    return _logmod_fd_sink_writev(sink, info, &segment, 1);
+}
+
+static const struct logmod_sink_vtable g_fd_sink = {
+    _logmod_fd_sink_write, NULL, NULL, _logmod_fd_sink_writev
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init_fd(struct logmod_sink *sink,
+                    int fd,
+                    unsigned level,
+                    enum logmod_sink_formats format)
+{
+    logmod_err code;
+    LOGMOD_EXPECT(fd >= 0, LOGMOD_BAD_PARAMETER);
+    if ((code = logmod_sink_init(sink, &g_fd_sink, NULL, level, format))
+        != LOGMOD_OK)
+    {
+        return code;
     }
-    else {
-        LOGMOD_EXPECT(fprintf(output, "%s %s:%d: ", info->label->name,
-                              info->filename, info->line)
-                          >= 0,
-                      LOGMOD_ERRNO);
+    sink->fd = fd;
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_FD_SINK */
+
+#ifdef LOGMOD_MMAP_SINK
+#ifndef LOGMOD_ATOMICS
+#error "LOGMOD_MMAP_SINK requires atomic operations (GCC, Clang or C11)"
+#endif
+
+/** @brief Defined if posix_fallocate() is declared, on Linux */
+#if defined(__linux__)                                                        \
+    && (!defined(__STRICT_ANSI__) || defined(_GNU_SOURCE)                     \
+        || (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L)           \
+        || (defined(_XOPEN_SOURCE) && _XOPEN_SOURCE >= 600))
+#define _LOGMOD_FALLOCATE
+#endif
+
+/**
+ * @brief Map window `k` into its slot, extending the file to cover it
+ *
+ * Disk space is preallocated where supported, so that stores to the mapping
+ * can't fault for lack of space. Must be called with `map->busy` held.
+ */
+static logmod_err
+_logmod_mmap_map(struct logmod_sink *sink,
+                 struct logmod_mmap_window *window,
+                 logmod_uint64 k)
+{
+    struct logmod_mmap *map = sink->data;
+    const logmod_uint64 end = (k + 1) * map->window_size;
+    void *base;
+    if (map->allocated < end) {
+#ifdef _LOGMOD_FALLOCATE
+        if (posix_fallocate(sink->fd, (off_t)map->allocated,
+                            (off_t)(end - map->allocated))
+            != 0)
+#endif
+        {
+            LOGMOD_EXPECT(ftruncate(sink->fd, (off_t)end) == 0, LOGMOD_ERRNO);
+        }
+        map->allocated = end;
     }
-    LOGMOD_EXPECT(vfprintf(output, fmt, args) >= 0, LOGMOD_ERRNO);
-    LOGMOD_EXPECT(putc('\n', output) != EOF, LOGMOD_ERRNO);
-    LOGMOD_EXPECT(fflush(output) != EOF, LOGMOD_ERRNO);
+    base = mmap(NULL, map->window_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                sink->fd, (off_t)(k * map->window_size));
+    LOGMOD_EXPECT(base != MAP_FAILED, LOGMOD_ERRNO);
+    window->base = base;
+    LOGMOD_ATOMIC_STORE(logmod_uint64, &window->index, k + 1);
     return LOGMOD_OK;
 }
 
-static struct logmod g_logmod;
+/**
+ * @brief Get the slot of window `k`, mapping the window once the slot's
+ * previous window has been filled and unmapped
+ */
+static logmod_err
+_logmod_mmap_window(struct logmod_sink *sink,
+                    logmod_uint64 k,
+                    struct logmod_mmap_window **p_window)
+{
+    struct logmod_mmap *map = sink->data;
+    struct logmod_mmap_window *window =
+        &map->windows[k % LOGMOD_MMAP_WINDOWS];
+    while (LOGMOD_ATOMIC_LOAD(logmod_uint64, &window->index) != k + 1) {
+        int unlocked = 0;
+        logmod_err code = LOGMOD_OK;
+        if (LOGMOD_ATOMIC_LOAD(logmod_uint64, &window->next) != k
+            || !LOGMOD_ATOMIC_CAS(int, &map->busy, &unlocked, 1))
+        {
+            sched_yield(); /* previous window still being filled */
+            continue;
+        }
+        if (LOGMOD_ATOMIC_LOAD(logmod_uint64, &window->index) != k + 1)
+            code = _logmod_mmap_map(sink, window, k);
+        LOGMOD_ATOMIC_STORE(int, &map->busy, 0);
+        if (code != LOGMOD_OK) return code;
+    }
+    *p_window = window;
+    return LOGMOD_OK;
+}
 
-/** global logger used as a fallback */
-static struct logmod_logger g_loggers[] = {
+/** @brief Account for `length` bytes copied into window `k` */
+static void
+_logmod_mmap_filled(struct logmod_mmap *map,
+                    struct logmod_mmap_window *window,
+                    logmod_uint64 k,
+                    size_t length)
+{
+    if (LOGMOD_ATOMIC_FETCH_ADD(size_t, &window->filled, length) + length
+        < map->window_size)
     {
-        LOGMOD_FALLBACK_CONTEXT_ID,
-        { NULL, 0, 1 },
-        &g_logmod.counter,
-        NULL,
-        NULL,
-        default_labels,
-        0,
-    },
-};
-/** global logmod used as a fallback */
-static struct logmod g_logmod = {
-    LOGMOD_FALLBACK_APPLICATION_ID,
-    g_loggers,
-    sizeof(g_loggers) / sizeof *g_loggers,
-    sizeof(g_loggers) / sizeof *g_loggers,
-    0,
-    { NULL, 0, 1 },
-    _logmod_lock_noop,
-};
+        return;
+    }
+    /* last writer of the window, hand the slot over to window k + N */
+    if (LOGMOD_ATOMIC_LOAD(logmod_uint64, &window->index))
+        munmap(window->base, map->window_size);
+    window->filled = 0;
+    LOGMOD_ATOMIC_STORE(logmod_uint64, &window->index, 0);
+    LOGMOD_ATOMIC_STORE(logmod_uint64, &window->next,
+                        k + LOGMOD_MMAP_WINDOWS);
+}
 
-static struct logmod_info
-_logmod_info_populate(const struct logmod_logger *logger,
-                      const unsigned line,
-                      const char *const filename,
-                      const unsigned level)
+/**
+ * @brief Account for the reserved bytes from `pos` to `end` that won't be
+ * written, so that their windows are still handed over once filled
+ */
+static void
+_logmod_mmap_skip(struct logmod_mmap *map,
+                  logmod_uint64 pos,
+                  const logmod_uint64 end)
 {
-    const struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
-    const time_t time_raw = time(NULL);
-    struct logmod_info info;
-    unsigned *mut_line = (unsigned *)&info.line;
-    const char **mut_filename = (const char **)&info.filename;
-    unsigned *mut_level = (unsigned *)&info.level;
-    const struct logmod_label **mut_label =
-        (const struct logmod_label **)&info.label;
-    struct tm *mut_time = (struct tm *)&info.time;
-    *mut_line = line;
-    *mut_filename = filename;
-    *mut_level = level;
-    *mut_label = logmod_logger_get_label(logger, level);
-    logmod->lock(logger, 1);
-    *mut_time = *localtime(&time_raw);
-    logmod->lock(logger, 0);
-    return info;
+    LOGMOD_ATOMIC_FETCH_ADD(logmod_uint64, &map->lost, end - pos);
+    while (pos < end) {
+        const logmod_uint64 k = pos / map->window_size;
+        struct logmod_mmap_window *window =
+            &map->windows[k % LOGMOD_MMAP_WINDOWS];
+        const size_t at = (size_t)(pos % map->window_size);
+        const size_t chunk = end - pos < map->window_size - at
+                                 ? (size_t)(end - pos)
+                                 : map->window_size - at;
+        while (LOGMOD_ATOMIC_LOAD(logmod_uint64, &window->next) != k)
+            sched_yield(); /* previous window still being filled */
+        _logmod_mmap_filled(map, window, k, chunk);
+        pos += chunk;
+    }
 }
 
-LOGMOD_API logmod_err
-_logmod_log(const struct logmod_logger *logger,
-            const unsigned line,
-            const char *const filename,
-            const unsigned level,
-            const char *fmt,
-            ...)
+static logmod_err
+_logmod_mmap_sink_writev(struct logmod_sink *sink,
+                         const struct logmod_info *info,
+                         const struct logmod_segment segments[],
+                         unsigned count)
 {
-    struct logmod *logmod =
-        LOGMOD_FROM_LOGGER(!logger ? (logger = &g_loggers[0]) : logger);
-    logmod_err code = LOGMOD_OK_SKIPPED;
-    if (!logger->disabled) {
-        const struct logmod_info info =
-            _logmod_info_populate(logger, line, filename, level);
-        va_list args;
-        code = LOGMOD_OK_CONTINUE;
-        if (logger->callback) {
-            va_start(args, fmt);
-            if ((code = logger->callback(logger, &info, fmt, args))
-                < LOGMOD_OK)
-            {
-                goto _end;
-            }
-            va_end(args);
-        }
-        if (level >= logger->options.level && code == LOGMOD_OK_CONTINUE) {
-            if (!logger->options.quiet || level == LOGMOD_LEVEL_FATAL) {
-                va_start(args, fmt);
-                if ((code = _logmod_print(
-                         logger, &info, fmt, args, logger->options.color,
-                         info.label->output == 0 ? stdout : stderr))
+    struct logmod_mmap *map = sink->data;
+    struct logmod_mmap_window *window = NULL;
+    logmod_uint64 pos, end, k = 0;
+    size_t length = 0, copied = 0;
+    unsigned i;
+    (void)info;
+    for (i = 0; i < count; ++i)
+        length += segments[i].length;
+    pos = LOGMOD_ATOMIC_FETCH_ADD(logmod_uint64, &map->offset, length);
+    end = pos + length;
+    for (i = 0; i < count; ++i) {
+        const char *data = segments[i].data;
+        size_t left = segments[i].length;
+        while (left) {
+            const size_t at = (size_t)(pos % map->window_size);
+            const size_t chunk =
+                left < map->window_size - at ? left : map->window_size - at;
+            if (!window || pos / map->window_size != k) {
+                logmod_err code;
+                if (window) _logmod_mmap_filled(map, window, k, copied);
+                k = pos / map->window_size;
+                copied = 0;
+                if ((code = _logmod_mmap_window(sink, k, &window))
                     != LOGMOD_OK)
                 {
-                    goto _end;
+                    /* other threads wait for the rest to be filled */
+                    _logmod_mmap_skip(map, pos, end);
+                    return code;
                 }
-                va_end(args);
-            }
-            if (logger->options.logfile) {
-                va_start(args, fmt);
-                code = _logmod_print(logger, &info, fmt, args, 0,
-                                     logger->options.logfile);
             }
+            memcpy(window->base + at, data, chunk);
+            copied += chunk;
+            pos += chunk;
+            data += chunk;
+            left -= chunk;
+        }
+    }
+    if (window) _logmod_mmap_filled(map, window, k, copied);
+    return LOGMOD_OK;
+}
+
+static logmod_err
+_logmod_mmap_sink_write(struct logmod_sink *sink,
+                        const struct logmod_info *info,
+                        const char *line,
+                        size_t length)
+{
+    struct logmod_segment segment;
+    segment.data = line;
+    segment.length = length;
+    return _logmod_mmap_sink_writev(sink, info, &segment, 1);
+}
+
+static void
+_logmod_mmap_sink_close(struct logmod_sink *sink)
+{
+    struct logmod_mmap *map = sink->data;
+    unsigned i;
+    for (i = 0; i < LOGMOD_MMAP_WINDOWS; ++i) {
+        if (map->windows[i].index) {
+            munmap(map->windows[i].base, map->window_size);
+            map->windows[i].index = 0;
+        }
+    }
+    if (ftruncate(sink->fd, (off_t)map->offset) == 0)
+        map->allocated = map->offset;
+}
+
+static const struct logmod_sink_vtable g_mmap_sink = {
+    _logmod_mmap_sink_write, NULL, _logmod_mmap_sink_close,
+    _logmod_mmap_sink_writev
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init_mmap(struct logmod_sink *sink,
+                      struct logmod_mmap *map,
+                      int fd,
+                      size_t window_size,
+                      unsigned level,
+                      enum logmod_sink_formats format)
+{
+    const long page_size = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    logmod_uint64 k;
+    logmod_err code;
+    unsigned i;
+    LOGMOD_EXPECT(map != NULL && fd >= 0, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(page_size > 0 && window_size != 0
+                      && window_size % (size_t)page_size == 0,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(fstat(fd, &st) == 0, LOGMOD_ERRNO);
+    if ((code = logmod_sink_init(sink, &g_mmap_sink, map, level, format))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    sink->fd = fd;
+    memset(map, 0, sizeof *map);
+    map->window_size = window_size;
+    map->offset = map->allocated = (logmod_uint64)st.st_size;
+    /* records are appended, the first window may be partly filled already */
+    k = map->offset / window_size;
+    for (i = 0; i < LOGMOD_MMAP_WINDOWS; ++i)
+        map->windows[(k + i) % LOGMOD_MMAP_WINDOWS].next = k + i;
+    map->windows[k % LOGMOD_MMAP_WINDOWS].filled =
+        (size_t)(map->offset % window_size);
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_MMAP_SINK */
+
+#ifdef LOGMOD_URING_SINK
+#ifndef LOGMOD_ATOMICS
+#error "LOGMOD_URING_SINK requires atomic operations (GCC, Clang or C11)"
+#endif
+
+static void
+_logmod_uring_teardown(struct logmod_uring *uring)
+{
+    if (uring->sqes) munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring && uring->cq_ring != uring->sq_ring)
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring) munmap(uring->sq_ring, uring->sq_ring_size);
+    uring->sq_ring = uring->cq_ring = uring->sqes = NULL;
+    if (uring->ring_fd >= 0) close(uring->ring_fd);
+    uring->ring_fd = -1;
+}
+
+/**
+ * @brief Map a ring region, NULL on failure
+ */
+static void *
+_logmod_uring_mmap(struct logmod_uring *uring, size_t size, off_t offset)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      uring->ring_fd, offset);
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
+/**
+ * @brief Set up an io_uring instance and register the sink's buffers
+ *
+ * Failures aren't logged, as the caller falls back to writev().
+ */
+static logmod_err
+_logmod_uring_setup(struct logmod_uring *uring)
+{
+    struct io_uring_params params;
+    struct iovec iov[LOGMOD_URING_BUFFERS];
+    char *sq_ring, *cq_ring;
+    unsigned i;
+    long ring_fd;
+
+    memset(&params, 0, sizeof params);
+    ring_fd = syscall(__NR_io_uring_setup, uring->num_buffers, &params);
+    if (ring_fd < 0) return LOGMOD_ERRNO;
+    uring->ring_fd = (int)ring_fd;
+    uring->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_ring_size > uring->sq_ring_size)
+            uring->sq_ring_size = uring->cq_ring_size;
+        uring->sq_ring = _logmod_uring_mmap(uring, uring->sq_ring_size,
+                                            (off_t)IORING_OFF_SQ_RING);
+        uring->cq_ring = uring->sq_ring;
+    }
+    else {
+        uring->sq_ring = _logmod_uring_mmap(uring, uring->sq_ring_size,
+                                            (off_t)IORING_OFF_SQ_RING);
+        uring->cq_ring = _logmod_uring_mmap(uring, uring->cq_ring_size,
+                                            (off_t)IORING_OFF_CQ_RING);
+    }
+    uring->sqes =
+        _logmod_uring_mmap(uring, uring->sqes_size, (off_t)IORING_OFF_SQES);
+    if (!uring->sq_ring || !uring->cq_ring || !uring->sqes) {
+        _logmod_uring_teardown(uring);
+        return LOGMOD_ERRNO;
+    }
+
+    sq_ring = uring->sq_ring;
+    cq_ring = uring->cq_ring;
+    uring->sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+    uring->sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+    uring->sq_mask = (unsigned *)(sq_ring + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+    uring->cq_head = (unsigned *)(cq_ring + params.cq_off.head);
+    uring->cq_tail = (unsigned *)(cq_ring + params.cq_off.tail);
+    uring->cq_mask = (unsigned *)(cq_ring + params.cq_off.ring_mask);
+    uring->cqes = cq_ring + params.cq_off.cqes;
+
+    /* pinned once, rather than on every write; plain writes otherwise */
+    for (i = 0; i < uring->num_buffers; ++i) {
+        iov[i].iov_base = uring->buffers + i * uring->buffer_size;
+        iov[i].iov_len = uring->buffer_size;
+    }
+    uring->fixed = syscall(__NR_io_uring_register, uring->ring_fd,
+                           IORING_REGISTER_BUFFERS, iov, uring->num_buffers)
+                   == 0;
+    return LOGMOD_OK;
+}
+
+/**
+ * @brief Queue the write of what is left of buffer `index`
+ *
+ * Submitted by the next _logmod_uring_enter().
+ */
+static void
+_logmod_uring_prep(struct logmod_sink *sink, unsigned index)
+{
+    struct logmod_uring *uring = sink->data;
+    const unsigned tail = *uring->sq_tail, slot = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)uring->sqes + slot;
+    char *data = uring->buffers + index * uring->buffer_size;
+
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = uring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = sink->fd;
+    sqe->off = uring->writes[index].offset;
+    sqe->addr = (unsigned long)(data + uring->writes[index].done);
+    sqe->len =
+        (unsigned)(uring->writes[index].length - uring->writes[index].done);
+    if (uring->fixed) sqe->buf_index = (unsigned short)index;
+    sqe->user_data = index;
+    uring->sq_array[slot] = slot;
+    LOGMOD_ATOMIC_STORE(unsigned, uring->sq_tail, tail + 1);
+}
+
+/**
+ * @brief Process completed writes, resuming short ones
+ *
+ * The first failure is kept in `uring->error` until reported. Completions
+ * are left to the waiting thread, if any, which would otherwise wait for
+ * one that was already reaped.
+ *
+ * @return Number of writes queued again
+ */
+static unsigned
+_logmod_uring_reap(struct logmod_sink *sink)
+{
+    struct logmod_uring *uring = sink->data;
+    const unsigned tail = LOGMOD_ATOMIC_LOAD(unsigned, uring->cq_tail);
+    unsigned head = *uring->cq_head, queued = 0;
+
+    if (uring->waiting) return 0;
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe =
+            (struct io_uring_cqe *)uring->cqes + (head & *uring->cq_mask);
+        const unsigned index = (unsigned)cqe->user_data;
+        struct logmod_uring_write *entry = &uring->writes[index];
+
+        if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+            _logmod_uring_prep(sink, index);
+            ++queued;
+            continue;
+        }
+        if (cqe->res <= 0) {
+            if (!uring->error) uring->error = cqe->res ? -cqe->res : EIO;
+        }
+        else {
+            entry->done += (size_t)cqe->res;
+            entry->offset += (logmod_uint64)cqe->res;
+            if (entry->done < entry->length) { /* short write */
+                _logmod_uring_prep(sink, index);
+                ++queued;
+                continue;
+            }
+        }
+        entry->length = 0;
+        --uring->in_flight;
+    }
+    LOGMOD_ATOMIC_STORE(unsigned, uring->cq_head, head);
+    return queued;
+}
+
+/**
+ * @brief Submit queued writes, and wait for one to complete if `wait`
+ *
+ * Writes resumed by the completions reaped are submitted right away.
+ * Failures aren't logged, they're returned to the logging call.
+ */
+static logmod_err
+_logmod_uring_enter(struct logmod_sink *sink, int wait)
+{
+    struct logmod_uring *uring = sink->data;
+    do {
+        const unsigned to_submit =
+            *uring->sq_tail - LOGMOD_ATOMIC_LOAD(unsigned, uring->sq_head);
+        if ((to_submit || wait)
+            && syscall(__NR_io_uring_enter, uring->ring_fd, to_submit,
+                       wait ? 1U : 0U, wait ? IORING_ENTER_GETEVENTS : 0U,
+                       (void *)NULL, 0)
+                   < 0
+            && errno != EINTR)
+        {
+            return LOGMOD_ERRNO;
+        }
+        wait = 0;
+    } while (_logmod_uring_reap(sink));
+    return LOGMOD_OK;
+}
+
+/**
+ * @brief Write the current buffer out, and move on to the next one
+ *
+ * The next buffer is waited for once a record has to be copied into it.
+ */
+static logmod_err
+_logmod_uring_submit(struct logmod_sink *sink)
+{
+    struct logmod_uring *uring = sink->data;
+    struct logmod_uring_write *entry = &uring->writes[uring->current];
+
+    entry->offset = uring->offset;
+    entry->done = 0;
+    entry->length = uring->filled;
+    uring->offset += uring->filled;
+    uring->filled = 0;
+    ++uring->in_flight;
+    _logmod_uring_prep(sink, uring->current);
+    uring->current = (uring->current + 1) % uring->num_buffers;
+    return _logmod_uring_enter(sink, 0);
+}
+
+/** @brief Report a failed write, once */
+static logmod_err
+_logmod_uring_error(struct logmod_uring *uring, logmod_err code)
+{
+    if (code == LOGMOD_OK && uring->error) {
+        errno = uring->error;
+        uring->error = 0;
+        code = LOGMOD_ERRNO;
+    }
+    return code;
+}
+
+static void
+_logmod_uring_lock(struct logmod_uring *uring)
+{
+    int unlocked = 0;
+    while (!LOGMOD_ATOMIC_CAS(int, &uring->busy, &unlocked, 1)) {
+        unlocked = 0;
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Wait for a write to complete, without holding `uring->busy`
+ *
+ * Only one thread waits in the kernel, the others yield until it is done.
+ * Must be called with `uring->busy` held, which is held again on return.
+ */
+static logmod_err
+_logmod_uring_wait(struct logmod_sink *sink)
+{
+    struct logmod_uring *uring = sink->data;
+    const int waiter = !uring->waiting;
+    int failed = 0, error = 0;
+
+    if (waiter) uring->waiting = 1;
+    LOGMOD_ATOMIC_STORE(int, &uring->busy, 0);
+    if (!waiter) {
+        sched_yield();
+    }
+    else if (syscall(__NR_io_uring_enter, uring->ring_fd, 0U, 1U,
+                     IORING_ENTER_GETEVENTS, (void *)NULL, 0)
+                 < 0
+             && errno != EINTR)
+    {
+        failed = 1;
+        error = errno;
+    }
+    _logmod_uring_lock(uring);
+    if (!waiter) return LOGMOD_OK;
+    uring->waiting = 0;
+    if (failed) {
+        errno = error;
+        return LOGMOD_ERRNO;
+    }
+    return _logmod_uring_enter(sink, 0);
+}
+
+static logmod_err
+_logmod_uring_sink_writev(struct logmod_sink *sink,
+                          const struct logmod_info *info,
+                          const struct logmod_segment segments[],
+                          unsigned count)
+{
+    struct logmod_uring *uring = sink->data;
+    logmod_err code = LOGMOD_OK;
+    unsigned i;
+    (void)info;
+
+    _logmod_uring_lock(uring);
+    code = _logmod_uring_enter(sink, 0);
+    for (i = 0; i < count && code == LOGMOD_OK; ++i) {
+        const char *data = segments[i].data;
+        size_t left = segments[i].length;
+        while (left && code == LOGMOD_OK) {
+            const size_t room = uring->buffer_size - uring->filled;
+            const size_t chunk = left < room ? left : room;
+            if (uring->writes[uring->current].length) { /* still written */
+                code = _logmod_uring_wait(sink);
+                continue;
+            }
+            memcpy(uring->buffers + uring->current * uring->buffer_size
+                       + uring->filled,
+                   data, chunk);
+            uring->filled += chunk;
+            data += chunk;
+            left -= chunk;
+            if (uring->filled == uring->buffer_size)
+                code = _logmod_uring_submit(sink);
+        }
+    }
+    code = _logmod_uring_error(uring, code);
+    LOGMOD_ATOMIC_STORE(int, &uring->busy, 0);
+    return code;
+}
+
+static logmod_err
+_logmod_uring_sink_write(struct logmod_sink *sink,
+                         const struct logmod_info *info,
+                         const char *line,
+                         size_t length)
+{
+    struct logmod_segment segment;
+    segment.data = line;
+    segment.length = length;
+    return _logmod_uring_sink_writev(sink, info, &segment, 1);
+}
+
+static logmod_err
+_logmod_uring_sink_flush(struct logmod_sink *sink)
+{
+    struct logmod_uring *uring = sink->data;
+    logmod_err code;
+    _logmod_uring_lock(uring);
+    code = uring->filled ? _logmod_uring_submit(sink)
+                         : _logmod_uring_enter(sink, 0);
+    code = _logmod_uring_error(uring, code);
+    LOGMOD_ATOMIC_STORE(int, &uring->busy, 0);
+    return code;
+}
+
+static void
+_logmod_uring_sink_close(struct logmod_sink *sink)
+{
+    struct logmod_uring *uring = sink->data;
+    logmod_err code = LOGMOD_OK;
+    _logmod_uring_lock(uring);
+    if (uring->filled) code = _logmod_uring_submit(sink);
+    while (code == LOGMOD_OK && uring->in_flight)
+        code = _logmod_uring_enter(sink, 1);
+    if (code != LOGMOD_OK && !uring->error) uring->error = errno;
+    _logmod_uring_teardown(uring);
+    LOGMOD_ATOMIC_STORE(int, &uring->busy, 0);
+}
+
+static const struct logmod_sink_vtable g_uring_sink = {
+    _logmod_uring_sink_write, _logmod_uring_sink_flush,
+    _logmod_uring_sink_close, _logmod_uring_sink_writev
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init_uring(struct logmod_sink *sink,
+                       struct logmod_uring *uring,
+                       int fd,
+                       char *buffers,
+                       size_t buffer_size,
+                       unsigned num_buffers,
+                       unsigned level,
+                       enum logmod_sink_formats format)
+{
+    logmod_err code;
+    off_t offset;
+    int flags;
+    LOGMOD_EXPECT(uring != NULL && buffers != NULL && buffer_size != 0,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(num_buffers != 0 && num_buffers <= LOGMOD_URING_BUFFERS,
+                  LOGMOD_BAD_PARAMETER);
+    if ((code = logmod_sink_init_fd(sink, fd, level, format)) != LOGMOD_OK)
+        return code;
+    memset(uring, 0, sizeof *uring);
+    uring->ring_fd = -1;
+    uring->buffers = buffers;
+    uring->buffer_size = buffer_size;
+    uring->num_buffers = num_buffers;
+    /* writes are placed at explicit offsets, which O_APPEND would ignore */
+    if ((flags = fcntl(fd, F_GETFL)) < 0 || (flags & O_APPEND)
+        || (offset = lseek(fd, 0, SEEK_END)) < 0
+        || _logmod_uring_setup(uring) != LOGMOD_OK)
+    {
+        return LOGMOD_OK; /* keep writing with writev() */
+    }
+    uring->offset = (logmod_uint64)offset;
+    sink->vtable = &g_uring_sink;
+    sink->data = uring;
+    /* a write per batch, rather than per record */
+    sink->flush.interval_ms = 100;
+    sink->flush.level = LOGMOD_LEVEL_ERROR;
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_URING_SINK */
+
+LOGMOD_API logmod_err
+logmod_logger_add_sink(struct logmod_logger *logger, struct logmod_sink *sink)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    unsigned i;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(sink != NULL && sink->vtable != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(logger->num_sinks < LOGMOD_MAX_SINKS, LOGMOD_BAD_PARAMETER);
+    for (i = 0; i < logger->num_sinks && logger->sinks[i] != sink; ++i)
+        continue;
+    LOGMOD_EXPECT(i == logger->num_sinks, LOGMOD_BAD_PARAMETER);
+    mut_logger->sinks[mut_logger->num_sinks++] = sink;
+    ++sink->refs;
+    _logmod_logger_update_sinks(mut_logger);
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_logger_remove_sink(struct logmod_logger *logger,
+                          struct logmod_sink *sink)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    logmod_err code = LOGMOD_OK;
+    unsigned i;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    for (i = 0; i < logger->num_sinks && logger->sinks[i] != sink; ++i)
+        continue;
+    LOGMOD_EXPECT(i < logger->num_sinks, LOGMOD_BAD_PARAMETER);
+    for (--mut_logger->num_sinks; i < logger->num_sinks; ++i)
+        mut_logger->sinks[i] = mut_logger->sinks[i + 1];
+    _logmod_logger_update_sinks(mut_logger);
+
+    if (sink->pending.records && sink->vtable->flush) {
+        code = sink->vtable->flush(sink);
+        memset(&sink->pending, 0, sizeof sink->pending);
+    }
+    if (--sink->refs == 0 && sink->vtable->close) sink->vtable->close(sink);
+    return code;
+}
+
+LOGMOD_API logmod_err
+logmod_logger_set_counter(struct logmod_logger *logger, int show_counter)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    mut_logger->options.hide_counter = !show_counter;
+    return LOGMOD_OK;
+}
+
+LOGMOD_API const struct logmod_label *
+logmod_logger_get_label(const struct logmod_logger *logger,
+                        const unsigned level)
+{
+    static const struct logmod_label unknown_label = {
+        "#UNKNOWN LABEL!!",
+        LOGMOD_LABEL_COLOR(STRIKETHROUGH, BACKGROUND_INTENSITY, YELLOW), 1
+    };
+    if (level < LOGMOD_LEVEL_CUSTOM) {
+        return &default_labels[level];
+    }
+    if (logger && level >= LOGMOD_LEVEL_CUSTOM
+        && level < (LOGMOD_LEVEL_CUSTOM + logger->num_custom_labels))
+    {
+        return &logger->custom_labels[level - LOGMOD_LEVEL_CUSTOM];
+    }
+    logmod_nlog(ERROR, NULL,
+                ("Invalid log level %u for logger %s", level,
+                 logger ? logger->context_id : "NULL"),
+                2);
+    return &unknown_label;
+}
+
+LOGMOD_API long
+logmod_logger_get_level(const struct logmod_logger *logger,
+                        const char *const label)
+{
+    size_t i;
+    LOGMOD_EXPECT(logger != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(label != NULL, LOGMOD_BAD_PARAMETER);
+    for (i = 0; i < __LOGMOD_LEVEL_MAX; ++i) {
+        if (strcmp(label, default_labels[i].name) == 0) {
+            return (long)i;
+        }
+    }
+    for (i = 0; i < logger->num_custom_labels; ++i) {
+        if (strcmp(label, logger->custom_labels[i].name) == 0) {
+            return (long)(i + LOGMOD_LEVEL_CUSTOM);
+        }
+    }
+    return LOGMOD_BAD_PARAMETER;
+}
+
+LOGMOD_API long
+logmod_logger_get_counter(const struct logmod_logger *logger)
+{
+    struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
+    long counter;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+#ifdef LOGMOD_ATOMICS
+    counter = LOGMOD_ATOMIC_LOAD(long, &logmod->counter);
+#else
+    logmod->lock(logger, 1);
+    counter = logmod->counter;
+    logmod->lock(logger, 0);
+#endif
+    return counter;
+}
+
+LOGMOD_API unsigned long
+logmod_logger_get_dropped(const struct logmod_logger *logger, unsigned level)
+{
+    if (!logger) return 0;
+    if (level > LOGMOD_LEVEL_CUSTOM) level = LOGMOD_LEVEL_CUSTOM;
+#ifdef LOGMOD_ATOMICS
+    return LOGMOD_ATOMIC_LOAD(unsigned long, &logger->dropped[level]);
+#else
+    return logger->dropped[level];
+#endif
+}
+
+/** @brief FNV-1a hash of a context ID */
+static unsigned long
+_logmod_hash(const char *str)
+{
+    unsigned long hash = 2166136261UL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash = (hash * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Look a logger up in the logger table's index
+ *
+ * Safe to call without the lock: buckets are published only once their
+ * logger is fully initialized.
+ *
+ * @param slot Set to the first empty bucket of the probe sequence, or to
+ * `real_length` if there is none
+ */
+static struct logmod_logger *
+_logmod_logger_find(const struct logmod *logmod,
+                    const char *const context_id,
+                    const unsigned long hash,
+                    size_t *slot)
+{
+    size_t pos = hash % logmod->real_length, i;
+    for (i = 0; i < logmod->real_length; ++i) {
+        const struct logmod_logger *logger;
+#ifdef LOGMOD_ATOMICS
+        const size_t bucket =
+            LOGMOD_ATOMIC_LOAD(size_t, &logmod->loggers[pos].bucket);
+#else
+        const size_t bucket = logmod->loggers[pos].bucket;
+#endif
+        if (!bucket) {
+            *slot = pos;
+            return NULL;
+        }
+        logger = &logmod->loggers[bucket - 1];
+        if (logger->hash == hash
+            && 0 == strcmp(logger->context_id, context_id))
+        {
+            return (struct logmod_logger *)logger;
+        }
+        if (++pos == logmod->real_length) pos = 0;
+    }
+    *slot = logmod->real_length;
+    return NULL;
+}
+
+LOGMOD_API struct logmod_logger *
+logmod_get_logger(struct logmod *logmod, const char *const context_id)
+{
+    struct logmod_logger *logger;
+    unsigned long hash;
+    size_t slot;
+    _LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER, NULL);
+    _LOGMOD_EXPECT(logmod->loggers != NULL, LOGMOD_BAD_PARAMETER, NULL);
+    _LOGMOD_EXPECT(context_id != NULL, LOGMOD_BAD_PARAMETER, NULL);
+    hash = _logmod_hash(context_id);
+#ifdef LOGMOD_ATOMICS
+    /* existing loggers are found without taking the lock */
+    if ((logger = _logmod_logger_find(logmod, context_id, hash, &slot)))
+        return logger;
+#endif
+    logmod->lock(NULL, 1);
+    /* might have been created while waiting for the lock */
+    if ((logger = _logmod_logger_find(logmod, context_id, hash, &slot))) {
+        logmod->lock(logger, 0);
+        return logger;
+    }
+    if (logmod->length < logmod->real_length) {
+        size_t *mut_length = (size_t *)&logmod->length;
+        struct logmod_mut_logger *mut_bucket =
+            (struct logmod_mut_logger *)&logmod->loggers[slot];
+        struct logmod_mut_logger *mut_logger =
+            (struct logmod_mut_logger *)&logmod->loggers[logmod->length];
+        /* entry was zeroed by logmod_init(), but may already be a bucket */
+        mut_logger->context_id = context_id;
+        mut_logger->counter = &logmod->counter;
+        mut_logger->options = logmod->default_options;
+        mut_logger->hash = hash;
+        mut_logger->generation = logmod->generation;
+        _logmod_logger_update_threshold(mut_logger);
+        _logmod_logger_update_identity(mut_logger);
+        ++*mut_length;
+#ifdef LOGMOD_ATOMICS
+        LOGMOD_ATOMIC_STORE(size_t, &mut_bucket->bucket, *mut_length);
+#else
+        mut_bucket->bucket = *mut_length;
+#endif
+        logmod->lock((struct logmod_logger *)mut_logger, 0);
+        return (struct logmod_logger *)mut_logger;
+    }
+    logmod->lock(NULL, 0);
+    return NULL;
+}
+
+LOGMOD_API struct logmod_logger *
+_logmod_get_logger_cached(struct logmod *logmod,
+                          const char *const context_id,
+                          struct logmod_logger_cache *cache)
+{
+    struct logmod_logger *logger;
+    _LOGMOD_EXPECT(cache != NULL, LOGMOD_BAD_PARAMETER, NULL);
+    logger = logmod_get_logger(logmod, context_id);
+    if (logger) {
+        cache->logger = logger;
+        /* published last, so that the logger is seen along with it */
+#ifdef LOGMOD_ATOMICS
+        LOGMOD_ATOMIC_STORE(unsigned long, &cache->generation,
+                            logmod->generation);
+#else
+        cache->generation = logmod->generation;
+#endif
+    }
+    return logger;
+}
+
+/** @brief Fixed-size buffer a log record is rendered into */
+struct _logmod_buffer {
+    char *data;
+    size_t size;
+    size_t length;
+    int overflow; /**< If 1, the rendered text didn't fit the buffer */
+};
+
+/**
+ * @brief A log record's message body, formatted once and shared by the
+ * callback and every output
+ *
+ * The body is rendered after LOGMOD_PREFIX_SIZE bytes of headroom, so each
+ * output can place its own (colored or plain) prefix right before it and
+ * write the whole line at once without copying the body.
+ */
+struct _logmod_message {
+    char data[LOGMOD_PREFIX_SIZE + LOGMOD_BUFFER_SIZE];
+    struct _logmod_buffer body;
+};
+
+/** @brief A log record being processed */
+struct _logmod_record {
+    struct logmod_info info;
+    char time[sizeof "YYYY-MM-DDTHH:MM:SS.uuuuuu+hh:mm"]; /**< Pre-rendered
+                                                             `info.time` */
+    struct _logmod_message message;
+    const char *fmt; /**< Format string of the message body */
+    va_list *args; /**< Format arguments, or NULL when no longer available */
+    const char *packed; /**< Arguments of `fmt` packed by
+                           _logmod_args_pack(), or NULL */
+    size_t packed_length; /**< Length of `packed` */
+    int formatted; /**< If 1, `message.body` holds the formatted message,
+                      otherwise it is formatted from `packed` on demand */
+    int utc_offset; /**< Minutes east of UTC of `info.time` */
+    size_t printed; /**< Length of the line last printed by _logmod_print() */
+};
+
+static logmod_err
+_logmod_buffer_vprintf(struct _logmod_buffer *buf,
+                       const char *fmt,
+                       va_list args)
+{
+    const size_t available = buf->size - buf->length;
+    const int length =
+        LOGMOD_VSNPRINTF(buf->data + buf->length, available, fmt, args);
+    LOGMOD_EXPECT(length >= 0, LOGMOD_ERRNO);
+    if ((size_t)length >= available) {
+        buf->length = buf->size - 1;
+        buf->overflow = 1;
+    }
+    else {
+        buf->length += (size_t)length;
+    }
+    return LOGMOD_OK;
+}
+
+static logmod_err
+_logmod_buffer_printf(struct _logmod_buffer *buf, const char *fmt, ...)
+    LOGMOD_PRINTF_LIKE(2, 3);
+
+static logmod_err
+_logmod_buffer_printf(struct _logmod_buffer *buf, const char *fmt, ...)
+{
+    logmod_err code;
+    va_list args;
+    va_start(args, fmt);
+    code = _logmod_buffer_vprintf(buf, fmt, args);
+    va_end(args);
+    return code;
+}
+
+static void
+_logmod_buffer_write(struct _logmod_buffer *buf,
+                     const char *data,
+                     size_t length)
+{
+    const size_t available = buf->size - 1 - buf->length;
+    if (length > available) {
+        length = available;
+        buf->overflow = 1;
+    }
+    memcpy(buf->data + buf->length, data, length);
+    buf->length += length;
+}
+
+static void
+_logmod_buffer_puts(struct _logmod_buffer *buf, const char *str)
+{
+    _logmod_buffer_write(buf, str, strlen(str));
+}
+
+/** @brief Type of the argument a conversion specification consumes */
+enum _logmod_arg_types {
+    _LOGMOD_ARG_NONE = 0, /**< `%%` */
+    _LOGMOD_ARG_CHAR, /**< int */
+    _LOGMOD_ARG_INTEGER, /**< Any integer, widened to logmod_uint64 */
+    _LOGMOD_ARG_DOUBLE,
+    _LOGMOD_ARG_LONG_DOUBLE,
+    _LOGMOD_ARG_STRING, /**< Copied by value */
+    _LOGMOD_ARG_POINTER,
+    _LOGMOD_ARG_UNSUPPORTED /**< Can't be deferred */
+};
+
+/** @brief A printf() conversion specification */
+struct _logmod_spec {
+    const char *start; /**< Position of the `%` in the format string */
+    const char *end; /**< Position right after the specification */
+    char text[32]; /**< Specification with the length modifier normalized
+                      to the type arguments are packed as */
+    char modifier[3]; /**< Length modifier */
+    char conversion; /**< Conversion specifier */
+    unsigned flags; /**< @ref _logmod_spec_flags */
+    int width; /**< Literal width, or -1 */
+    int width_star; /**< If 1, the width is given by an argument */
+    int num_stars; /**< Number of `*` widths and precisions */
+    int precision; /**< Literal precision, or -1 */
+    int precision_star; /**< If 1, the precision is given by an argument */
+    int native; /**< If 1, flags, width and precision are well-formed, and
+                   the specification may be rendered by LogMod itself */
+    unsigned type; /**< @ref _logmod_arg_types */
+};
+
+/** @brief Flags of a conversion specification */
+enum _logmod_spec_flags {
+    _LOGMOD_FLAG_MINUS = 1 << 0,
+    _LOGMOD_FLAG_PLUS = 1 << 1,
+    _LOGMOD_FLAG_SPACE = 1 << 2,
+    _LOGMOD_FLAG_HASH = 1 << 3,
+    _LOGMOD_FLAG_ZERO = 1 << 4
+};
+
+/** @brief Argument of a conversion specification */
+union _logmod_arg {
+    int character;
+    logmod_uint64 integer;
+    double real;
+    long double long_real;
+    const char *string;
+    void *pointer;
+};
+
+/** @brief Get the argument type consumed by a conversion specification */
+static unsigned
+_logmod_spec_type(const struct _logmod_spec *spec)
+{
+    const char *modifier = spec->modifier;
+    switch (spec->conversion) {
+    case '%':
+        return spec->end - spec->start == 2 ? _LOGMOD_ARG_NONE
+                                            : _LOGMOD_ARG_UNSUPPORTED;
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        if (!*modifier || (strchr("hzt", *modifier) && !modifier[1])
+            || 0 == strcmp(modifier, "hh") || 0 == strcmp(modifier, "l")
+            || 0 == strcmp(modifier, "ll"))
+        {
+            return _LOGMOD_ARG_INTEGER;
+        }
+        return _LOGMOD_ARG_UNSUPPORTED;
+    case 'e': case 'E': case 'f': case 'F':
+    case 'g': case 'G': case 'a': case 'A':
+        if (!*modifier || 0 == strcmp(modifier, "l"))
+            return _LOGMOD_ARG_DOUBLE;
+        if (0 == strcmp(modifier, "L")) return _LOGMOD_ARG_LONG_DOUBLE;
+        return _LOGMOD_ARG_UNSUPPORTED;
+    case 'c':
+        return *modifier ? _LOGMOD_ARG_UNSUPPORTED : _LOGMOD_ARG_CHAR;
+    case 's':
+        return *modifier ? _LOGMOD_ARG_UNSUPPORTED : _LOGMOD_ARG_STRING;
+    case 'p':
+        return *modifier ? _LOGMOD_ARG_UNSUPPORTED : _LOGMOD_ARG_POINTER;
+    default:
+        return _LOGMOD_ARG_UNSUPPORTED;
+    }
+}
+
+/**
+ * @brief Parse the first conversion specification of `fmt`
+ *
+ * @return 1 if a specification has been found, 0 otherwise
+ */
+static int
+_logmod_spec_parse(const char *fmt, struct _logmod_spec *spec)
+{
+    const char *flags, *modifier;
+    size_t num_flags, num_modifiers;
+
+    if (!(spec->start = strchr(fmt, '%'))) return 0;
+    spec->num_stars = 0;
+    spec->precision = -1;
+    spec->precision_star = 0;
+
+    /* flags, width and precision are kept as is */
+    flags = spec->start + 1;
+    num_flags = strspn(flags, "-+ #0123456789.*");
+    for (fmt = flags; fmt < flags + num_flags; ++fmt) {
+        if (*fmt == '*') {
+            ++spec->num_stars;
+        }
+        else if (*fmt == '.') {
+            spec->precision_star = fmt[1] == '*';
+            spec->precision = spec->precision_star ? -1 : atoi(fmt + 1);
+        }
+    }
+    /* and parsed again strictly, to be rendered natively */
+    spec->flags = 0;
+    spec->width = -1;
+    spec->width_star = 0;
+    for (fmt = flags; *fmt && strchr("-+ #0", *fmt); ++fmt) {
+        static const unsigned values[] = { _LOGMOD_FLAG_MINUS,
+                                           _LOGMOD_FLAG_PLUS,
+                                           _LOGMOD_FLAG_SPACE,
+                                           _LOGMOD_FLAG_HASH,
+                                           _LOGMOD_FLAG_ZERO };
+        spec->flags |= values[strchr("-+ #0", *fmt) - "-+ #0"];
+    }
+    if (*fmt == '*') {
+        spec->width_star = 1;
+        ++fmt;
+    }
+    else if (*fmt >= '1' && *fmt <= '9') {
+        for (spec->width = 0; *fmt >= '0' && *fmt <= '9'; ++fmt) {
+            if (spec->width < 10000)
+                spec->width = spec->width * 10 + (*fmt - '0');
+        }
+    }
+    if (*fmt == '.') {
+        if (*++fmt == '*') ++fmt;
+        while (*fmt >= '0' && *fmt <= '9')
+            ++fmt;
+    }
+    spec->native = fmt == flags + num_flags && spec->width < 10000
+                   && spec->precision < 10000;
+
+    modifier = flags + num_flags;
+    num_modifiers = strspn(modifier, "hlLqjzt");
+    spec->conversion = modifier[num_modifiers];
+    spec->end = modifier + num_modifiers + (spec->conversion != '\0');
+    if (num_flags + 5 > sizeof spec->text || num_modifiers > 2
+        || spec->num_stars > 2)
+    {
+        spec->type = _LOGMOD_ARG_UNSUPPORTED;
+        return 1;
+    }
+    memcpy(spec->modifier, modifier, num_modifiers);
+    spec->modifier[num_modifiers] = '\0';
+    spec->type = _logmod_spec_type(spec);
+
+    memcpy(spec->text, spec->start, num_flags + 1);
+    fmt = spec->type == _LOGMOD_ARG_INTEGER       ? "ll"
+          : spec->type == _LOGMOD_ARG_LONG_DOUBLE ? "L"
+                                                  : "";
+    strcpy(spec->text + num_flags + 1, fmt);
+    num_flags += strlen(fmt);
+    spec->text[num_flags + 1] = spec->conversion;
+    spec->text[num_flags + 2] = '\0';
+    return 1;
+}
+
+/** @brief Take an integer argument, and widen it to 64 bits */
+static logmod_uint64
+_logmod_arg_integer(const struct _logmod_spec *spec, va_list *args)
+{
+    const int is_signed = spec->conversion == 'd' || spec->conversion == 'i';
+    switch (spec->modifier[0]) {
+    case 'h':
+        if (spec->modifier[1] == 'h')
+            return is_signed ? (logmod_uint64)(signed char)va_arg(*args, int)
+                             : (unsigned char)va_arg(*args, int);
+        return is_signed ? (logmod_uint64)(short)va_arg(*args, int)
+                         : (unsigned short)va_arg(*args, int);
+    case 'l':
+        if (spec->modifier[1] == 'l') return va_arg(*args, logmod_uint64);
+        return is_signed ? (logmod_uint64)va_arg(*args, long)
+                         : va_arg(*args, unsigned long);
+    case 'z':
+        return va_arg(*args, size_t);
+    case 't':
+        return (logmod_uint64)va_arg(*args, ptrdiff_t);
+    default:
+        return is_signed ? (logmod_uint64)va_arg(*args, int)
+                         : va_arg(*args, unsigned);
+    }
+}
+
+/**
+ * @brief Capture the arguments of a message, to be formatted later by
+ * _logmod_args_render()
+ *
+ * Arguments are packed in order of appearance: `*` widths and precisions as
+ * int, integers widened to 64 bits, floating points as double (or long
+ * double), pointers as is, and strings copied by value.
+ *
+ * @return LOGMOD_OK, or LOGMOD_BAD_PARAMETER if the format has conversions
+ * that can't be deferred, or the arguments don't fit the buffer
+ */
+static logmod_err
+_logmod_args_pack(struct _logmod_buffer *buf, const char *fmt, va_list args)
+{
+    struct _logmod_spec spec;
+    va_list ap;
+    logmod_err code = LOGMOD_OK;
+
+    LOGMOD_VA_COPY(ap, args);
+    for (; code == LOGMOD_OK && _logmod_spec_parse(fmt, &spec);
+         fmt = spec.end)
+    {
+        int stars[2] = { 0, 0 }, i;
+        if (spec.type == _LOGMOD_ARG_UNSUPPORTED) {
+            code = LOGMOD_BAD_PARAMETER;
+            break;
+        }
+        for (i = 0; i < spec.num_stars; ++i) {
+            stars[i] = va_arg(ap, int);
+            _logmod_buffer_write(buf, (const char *)&stars[i], sizeof *stars);
+        }
+        switch (spec.type) {
+        case _LOGMOD_ARG_CHAR: {
+            const int value = va_arg(ap, int);
+            _logmod_buffer_write(buf, (const char *)&value, sizeof value);
+        } break;
+        case _LOGMOD_ARG_INTEGER: {
+            const logmod_uint64 value = _logmod_arg_integer(&spec, &ap);
+            _logmod_buffer_write(buf, (const char *)&value, sizeof value);
+        } break;
+        case _LOGMOD_ARG_DOUBLE: {
+            const double value = va_arg(ap, double);
+            _logmod_buffer_write(buf, (const char *)&value, sizeof value);
+        } break;
+        case _LOGMOD_ARG_LONG_DOUBLE: {
+            const long double value = va_arg(ap, long double);
+            _logmod_buffer_write(buf, (const char *)&value, sizeof value);
+        } break;
+        case _LOGMOD_ARG_STRING: {
+            const char *value = va_arg(ap, const char *);
+            int precision = spec.precision;
+            size_t length = 0;
+            if (spec.precision_star) precision = stars[spec.num_stars - 1];
+            if (!value) value = "(null)";
+            while ((precision < 0 || length < (size_t)precision)
+                   && value[length])
+            {
+                ++length;
+            }
+            _logmod_buffer_write(buf, value, length);
+            _logmod_buffer_write(buf, "", 1);
+        } break;
+        case _LOGMOD_ARG_POINTER: {
+            void *value = va_arg(ap, void *);
+            _logmod_buffer_write(buf, (const char *)&value, sizeof value);
+        } break;
+        default:
+            break;
+        }
+        if (buf->overflow) code = LOGMOD_BAD_PARAMETER;
+    }
+    va_end(ap);
+    return code;
+}
+
+/** @brief Pairs of decimal digits, from "00" to "99" */
+static const char _logmod_digit_pairs[] = "00010203040506070809"
+                                          "10111213141516171819"
+                                          "20212223242526272829"
+                                          "30313233343536373839"
+                                          "40414243444546474849"
+                                          "50515253545556575859"
+                                          "60616263646566676869"
+                                          "70717273747576777879"
+                                          "80818283848586878889"
+                                          "90919293949596979899";
+
+/**
+ * @brief Render `value` in decimal, right before `end`
+ *
+ * @return Position of the first digit
+ */
+static char *
+_logmod_render_decimal(char *end, logmod_uint64 value)
+{
+    while (value >= 100) {
+        const char *pair = _logmod_digit_pairs + (size_t)(value % 100) * 2;
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        const char *pair = _logmod_digit_pairs + (size_t)value * 2;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+static void
+_logmod_buffer_fill(struct _logmod_buffer *buf, const char c, size_t count)
+{
+    const size_t available = buf->size - 1 - buf->length;
+    if (count > available) {
+        count = available;
+        buf->overflow = 1;
+    }
+    memset(buf->data + buf->length, c, count);
+    buf->length += count;
+}
+
+/**
+ * @brief Write a converted value, padded to `width`
+ *
+ * @param prefix Sign or base prefix, zero padding goes after it
+ * @param zeros Number of leading zeros
+ */
+static void
+_logmod_buffer_field(struct _logmod_buffer *buf,
+                     const unsigned flags,
+                     const int width,
+                     const char *prefix,
+                     size_t zeros,
+                     const char *text,
+                     const size_t length)
+{
+    const size_t prefix_length = strlen(prefix),
+                 total = prefix_length + zeros + length;
+    size_t padding = width > 0 && (size_t)width > total
+                         ? (size_t)width - total
+                         : 0;
+    if (flags & _LOGMOD_FLAG_MINUS) {
+        _logmod_buffer_write(buf, prefix, prefix_length);
+        _logmod_buffer_fill(buf, '0', zeros);
+        _logmod_buffer_write(buf, text, length);
+        _logmod_buffer_fill(buf, ' ', padding);
+        return;
+    }
+    if (flags & _LOGMOD_FLAG_ZERO) {
+        zeros += padding;
+        padding = 0;
+    }
+    _logmod_buffer_fill(buf, ' ', padding);
+    _logmod_buffer_write(buf, prefix, prefix_length);
+    _logmod_buffer_fill(buf, '0', zeros);
+    _logmod_buffer_write(buf, text, length);
+}
+
+/** @brief Render an integer as `%d`, `%i`, `%u`, `%x` or `%X` would */
+static void
+_logmod_render_integer(struct _logmod_buffer *buf,
+                       const char conversion,
+                       unsigned flags,
+                       const int width,
+                       const int precision,
+                       logmod_uint64 value)
+{
+    char digits[24], *end = digits + sizeof digits, *start;
+    const char *prefix = "";
+    size_t length, zeros = 0;
+
+    if (conversion == 'x' || conversion == 'X') {
+        const char *hex =
+            conversion == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+        if ((flags & _LOGMOD_FLAG_HASH) && value)
+            prefix = conversion == 'x' ? "0x" : "0X";
+        start = end;
+        do {
+            *--start = hex[value & 15];
+            value >>= 4;
+        } while (value);
+    }
+    else {
+        if (conversion != 'u') {
+            if (value > ((logmod_uint64)-1 >> 1)) {
+                prefix = "-";
+                value = 0 - value;
+            }
+            else if (flags & _LOGMOD_FLAG_PLUS) {
+                prefix = "+";
+            }
+            else if (flags & _LOGMOD_FLAG_SPACE) {
+                prefix = " ";
+            }
+        }
+        start = _logmod_render_decimal(end, value);
+    }
+    length = (size_t)(end - start);
+    if (precision >= 0) {
+        flags &= ~(unsigned)_LOGMOD_FLAG_ZERO;
+        if (precision == 0 && length == 1 && *start == '0') length = 0;
+        if ((size_t)precision > length) zeros = (size_t)precision - length;
+    }
+    _logmod_buffer_field(buf, flags, width, prefix, zeros, start, length);
+}
+
+/**
+ * @brief Render a double as `%f` would, when it can be done exactly
+ *
+ * @return 0 if `value` is left to printf(): not finite, too large, too
+ * precise, negative zero, or too close to a rounding tie to tell
+ */
+static int
+_logmod_render_fixed(struct _logmod_buffer *buf,
+                     const unsigned flags,
+                     const int width,
+                     int precision,
+                     double value)
+{
+    static const double scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4,
+                                     1e5, 1e6, 1e7, 1e8, 1e9 };
+    static const double zero = 0.0;
+    char digits[40], *end = digits + sizeof digits, *start = end;
+    const char *prefix = "";
+    logmod_uint64 integral, fraction;
+    double rest;
+    int i;
+
+    if (precision < 0) precision = 6;
+    if (precision > 9) return 0;
+    if (value < 0) {
+        prefix = "-";
+        value = -value;
+    }
+    else if (value == 0 && memcmp(&value, &zero, sizeof value) != 0) {
+        return 0;
+    }
+    else if (flags & _LOGMOD_FLAG_PLUS) {
+        prefix = "+";
+    }
+    else if (flags & _LOGMOD_FLAG_SPACE) {
+        prefix = " ";
+    }
+    if (!(value < 1e15)) return 0;
+
+    /* integral and fractional parts are exact, scaling rounds once */
+    integral = (logmod_uint64)value;
+    rest = (value - (double)integral) * scales[precision];
+    fraction = (logmod_uint64)rest;
+    rest -= (double)fraction;
+    if (rest > 0.5 - 1e-6 && rest < 0.5 + 1e-6) return 0;
+    if (rest > 0.5 && ++fraction == (logmod_uint64)scales[precision]) {
+        fraction = 0;
+        ++integral;
+    }
+
+    for (i = 0; i < precision; ++i) {
+        *--start = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    if (precision > 0 || (flags & _LOGMOD_FLAG_HASH)) *--start = '.';
+    start = _logmod_render_decimal(start, integral);
+    _logmod_buffer_field(buf, flags, width, prefix, 0, start,
+                         (size_t)(end - start));
+    return 1;
+}
+
+/** @brief Format the specification with printf() */
+#define _LOGMOD_SPEC_PRINTF(_buf, _spec, _stars, _value)                      \
+    ((_spec)->num_stars == 0                                                  \
+         ? _logmod_buffer_printf((_buf), (_spec)->text, (_value))             \
+     : (_spec)->num_stars == 1                                                \
+         ? _logmod_buffer_printf((_buf), (_spec)->text, (_stars)[0],          \
+                                 (_value))                                    \
+         : _logmod_buffer_printf((_buf), (_spec)->text, (_stars)[0],          \
+                                 (_stars)[1], (_value)))
+
+/**
+ * @brief Format a conversion specification with its argument
+ *
+ * Integers, `%f`, strings, characters and pointers are rendered by LogMod,
+ * anything else by printf().
+ */
+static void
+_logmod_spec_render(struct _logmod_buffer *buf,
+                    const struct _logmod_spec *spec,
+                    const int stars[2],
+                    const union _logmod_arg *arg)
+{
+    unsigned flags = spec->flags;
+    int width = spec->width, precision = spec->precision;
+
+    if (spec->width_star) {
+        width = stars[0];
+        if (width < 0) {
+            flags |= _LOGMOD_FLAG_MINUS;
+            width = width < -10000 ? 10000 : -width;
+        }
+    }
+    if (spec->precision_star) precision = stars[spec->num_stars - 1];
+    if (precision < 0) precision = -1;
+
+    if (spec->native && width <= 10000 && precision <= 10000) {
+        switch (spec->type) {
+        case _LOGMOD_ARG_NONE:
+            _logmod_buffer_write(buf, "%", 1);
+            return;
+        case _LOGMOD_ARG_CHAR: {
+            const char c = (char)arg->character;
+            if (flags & ~(unsigned)_LOGMOD_FLAG_MINUS) break;
+            _logmod_buffer_field(buf, flags, width, "", 0, &c, 1);
+        }
+            return;
+        case _LOGMOD_ARG_INTEGER:
+            if (spec->conversion == 'o') break;
+            _logmod_render_integer(buf, spec->conversion, flags, width,
+                                   precision, arg->integer);
+            return;
+        case _LOGMOD_ARG_DOUBLE:
+            if ((spec->conversion == 'f' || spec->conversion == 'F')
+                && _logmod_render_fixed(buf, flags, width, precision,
+                                        arg->real))
+            {
+                return;
+            }
+            break;
+        case _LOGMOD_ARG_STRING: {
+            size_t length = 0;
+            if (!arg->string || (flags & ~(unsigned)_LOGMOD_FLAG_MINUS))
+                break;
+            while ((precision < 0 || length < (size_t)precision)
+                   && arg->string[length])
+            {
+                ++length;
+            }
+            _logmod_buffer_field(buf, flags, width, "", 0, arg->string,
+                                 length);
+        }
+            return;
+        case _LOGMOD_ARG_POINTER:
+            if (!arg->pointer || (flags & ~(unsigned)_LOGMOD_FLAG_MINUS)
+                || precision >= 0)
+            {
+                break;
+            }
+            _logmod_render_integer(buf, 'x', flags | _LOGMOD_FLAG_HASH,
+                                   width, -1,
+                                   (logmod_uint64)(size_t)arg->pointer);
+            return;
+        default:
+            break;
+        }
+    }
+
+    switch (spec->type) {
+    case _LOGMOD_ARG_CHAR:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->character);
+        break;
+    case _LOGMOD_ARG_INTEGER:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->integer);
+        break;
+    case _LOGMOD_ARG_DOUBLE:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->real);
+        break;
+    case _LOGMOD_ARG_LONG_DOUBLE:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->long_real);
+        break;
+    case _LOGMOD_ARG_STRING:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->string);
+        break;
+    case _LOGMOD_ARG_POINTER:
+        _LOGMOD_SPEC_PRINTF(buf, spec, stars, arg->pointer);
+        break;
+    default:
+        break;
+    }
+}
+
+#undef _LOGMOD_SPEC_PRINTF
+
+/** @brief Read the arguments of a supported conversion specification */
+static void
+_logmod_arg_read(const struct _logmod_spec *spec,
+                 va_list *args,
+                 int stars[2],
+                 union _logmod_arg *arg)
+{
+    int i;
+    stars[0] = stars[1] = 0;
+    for (i = 0; i < spec->num_stars; ++i) {
+        stars[i] = va_arg(*args, int);
+    }
+    switch (spec->type) {
+    case _LOGMOD_ARG_CHAR:
+        arg->character = va_arg(*args, int);
+        break;
+    case _LOGMOD_ARG_INTEGER:
+        arg->integer = _logmod_arg_integer(spec, args);
+        break;
+    case _LOGMOD_ARG_DOUBLE:
+        arg->real = va_arg(*args, double);
+        break;
+    case _LOGMOD_ARG_LONG_DOUBLE:
+        arg->long_real = va_arg(*args, long double);
+        break;
+    case _LOGMOD_ARG_STRING:
+        arg->string = va_arg(*args, const char *);
+        break;
+    case _LOGMOD_ARG_POINTER:
+        arg->pointer = va_arg(*args, void *);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Format a message into `buf`, as vsnprintf() would
+ *
+ * Conversions are rendered by _logmod_spec_render(). Messages with
+ * conversions whose arguments aren't known (such as `%n` or positional
+ * arguments) are left to vsnprintf() entirely.
+ */
+static logmod_err
+_logmod_buffer_format(struct _logmod_buffer *buf,
+                      const char *fmt,
+                      va_list args)
+{
+    const char *const start = fmt;
+    const size_t length = buf->length;
+    struct _logmod_spec spec;
+    logmod_err code = LOGMOD_OK;
+    va_list ap;
+
+    LOGMOD_VA_COPY(ap, args);
+    while (_logmod_spec_parse(fmt, &spec)) {
+        union _logmod_arg arg;
+        int stars[2];
+        if (spec.type == _LOGMOD_ARG_UNSUPPORTED) break;
+        _logmod_buffer_write(buf, fmt, (size_t)(spec.start - fmt));
+        _logmod_arg_read(&spec, &ap, stars, &arg);
+        _logmod_spec_render(buf, &spec, stars, &arg);
+        fmt = spec.end;
+    }
+    if (strchr(fmt, '%')) { /* stopped at an unknown conversion */
+        buf->length = length;
+        buf->overflow = 0;
+        code = _logmod_buffer_vprintf(buf, start, args);
+    }
+    else {
+        _logmod_buffer_puts(buf, fmt);
+        buf->data[buf->length] = '\0';
+    }
+    va_end(ap);
+    return code;
+}
+
+/**
+ * @brief Take `size` bytes of packed arguments, if there are that many left
+ * before `end`
+ */
+static int
+_logmod_args_take(const char **packed,
+                  const char *end,
+                  void *dest,
+                  size_t size)
+{
+    if ((size_t)(end - *packed) < size) return 0;
+    memcpy(dest, *packed, size);
+    *packed += size;
+    return 1;
+}
+
+/**
+ * @brief Format a message from the `length` bytes of arguments packed by
+ * _logmod_args_pack()
+ *
+ * Packed arguments may come from a binary stream: they are never read past
+ * `length`, the format being written as is from the first conversion whose
+ * argument is missing.
+ */
+static void
+_logmod_args_render(struct _logmod_buffer *buf,
+                    const char *fmt,
+                    const char *packed,
+                    size_t length)
+{
+    const char *const end = packed + length;
+    struct _logmod_spec spec;
+    for (; _logmod_spec_parse(fmt, &spec); fmt = spec.end) {
+        union _logmod_arg arg;
+        int stars[2] = { 0, 0 }, i, ok = 1;
+        for (i = 0; i < spec.num_stars && ok; ++i)
+            ok = _logmod_args_take(&packed, end, &stars[i], sizeof *stars);
+        switch (spec.type) {
+        case _LOGMOD_ARG_CHAR:
+            ok = ok
+                 && _logmod_args_take(&packed, end, &arg.character,
+                                      sizeof arg.character);
+            break;
+        case _LOGMOD_ARG_INTEGER:
+            ok = ok
+                 && _logmod_args_take(&packed, end, &arg.integer,
+                                      sizeof arg.integer);
+            break;
+        case _LOGMOD_ARG_DOUBLE:
+            ok = ok
+                 && _logmod_args_take(&packed, end, &arg.real,
+                                      sizeof arg.real);
+            break;
+        case _LOGMOD_ARG_LONG_DOUBLE:
+            ok = ok
+                 && _logmod_args_take(&packed, end, &arg.long_real,
+                                      sizeof arg.long_real);
+            break;
+        case _LOGMOD_ARG_STRING: {
+            const char *nul =
+                ok ? memchr(packed, '\0', (size_t)(end - packed)) : NULL;
+            ok = nul != NULL;
+            arg.string = packed;
+            if (ok) packed = nul + 1;
+        } break;
+        case _LOGMOD_ARG_POINTER:
+            ok = ok
+                 && _logmod_args_take(&packed, end, &arg.pointer,
+                                      sizeof arg.pointer);
+            break;
+        default:
+            break;
+        }
+        if (!ok) break; /* truncated, the rest is left unformatted */
+        _logmod_buffer_write(buf, fmt, (size_t)(spec.start - fmt));
+        _logmod_spec_render(buf, &spec, stars, &arg);
+    }
+    _logmod_buffer_puts(buf, fmt);
+    buf->data[buf->length] = '\0';
+}
+
+/** @brief Write `value` in decimal, left-justified to `width` characters */
+static void
+_logmod_buffer_long(struct _logmod_buffer *buf, const long value, size_t width)
+{
+    char digits[24], *start = digits + sizeof digits;
+    size_t length;
+    start = _logmod_render_decimal(start, value < 0
+                                              ? 0 - (logmod_uint64)value
+                                              : (logmod_uint64)value);
+    if (value < 0) *--start = '-';
+    length = (size_t)(digits + sizeof digits - start);
+    _logmod_buffer_write(buf, start, length);
+    for (; length < width; ++length)
+        _logmod_buffer_write(buf, " ", 1);
+}
+
+/** @brief Opening ANSI sequence of LOGMOD_ENCODE_STATIC() */
+#define _LOGMOD_ENCODE_OPEN(_style, _visibility, _color)                      \
+    "\x1b[" LOGMOD_STYLE_##_style ";" LOGMOD_VISIBILITY_##_visibility          \
+        LOGMOD_COLOR_##_color "m"
+/** @brief Closing ANSI sequence of LOGMOD_ENCODE_STATIC() */
+#define _LOGMOD_ENCODE_CLOSE "\x1b[0m"
+
+/** @brief Render the application and context IDs of the record prefix */
+static logmod_err
+_logmod_render_identity(const struct logmod_logger *logger,
+                        const int color,
+                        struct _logmod_buffer *buf)
+{
+    if (logger->options.show_application_id) {
+        const struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
+        LOGMOD_EXPECT(_logmod_buffer_printf(
+                          buf, LMT(color, BOLD, FOREGROUND, BLACK, "%s"),
+                          logmod->application_id)
+                          == LOGMOD_OK,
+                      LOGMOD_ERRNO);
+        _logmod_buffer_puts(buf, LMT(color, BOLD, FOREGROUND, BLACK, " » "));
+    }
+    if (!logger->options.hide_context_id) {
+        LOGMOD_EXPECT(_logmod_buffer_printf(
+                          buf, LMT(color, BOLD, FOREGROUND, WHITE, "%s"),
+                          logger->context_id)
+                          == LOGMOD_OK,
+                      LOGMOD_ERRNO);
+        _logmod_buffer_puts(buf, LMT(color, BOLD, FOREGROUND, WHITE, " » "));
+    }
+    return LOGMOD_OK;
+}
+
+/**
+ * @brief Pre-render the logger's application and context IDs
+ *
+ * Must be called whenever `options.show_application_id` or
+ * `options.hide_context_id` changes.
+ */
+static void
+_logmod_logger_update_identity(struct logmod_mut_logger *mut_logger)
+{
+    const struct logmod_logger *logger =
+        (const struct logmod_logger *)mut_logger;
+    struct _logmod_buffer buf;
+    int color;
+
+    mut_logger->identity_cached = 0;
+    buf.data = mut_logger->identity;
+    buf.size = sizeof mut_logger->identity;
+    buf.length = 0;
+    buf.overflow = 0;
+    for (color = 0; color < 2; ++color) {
+        const size_t start = buf.length;
+        if (_logmod_render_identity(logger, color, &buf) != LOGMOD_OK
+            || buf.overflow)
+        {
+            return;
+        }
+        mut_logger->identity_length[color] = buf.length - start;
+    }
+    mut_logger->identity_cached = 1;
+}
+
+/**
+ * @brief Render everything that comes before the message body
+ *
+ * Counter, time, application id, context id, label and file:line. Only
+ * copies strings, the IDs being pre-rendered.
+ */
+static logmod_err
+_logmod_render_prefix(const struct logmod_logger *logger,
+                      const struct _logmod_record *record,
+                      const int color,
+                      struct _logmod_buffer *buf)
+{
+    const struct logmod_info *info = &record->info;
+    if (!logger->options.hide_counter) {
+        if (color)
+            _logmod_buffer_puts(buf, _LOGMOD_ENCODE_OPEN(BOLD, FOREGROUND,
+                                                         WHITE));
+        _logmod_buffer_long(buf, info->counter, 3);
+        _logmod_buffer_puts(buf, color ? " " _LOGMOD_ENCODE_CLOSE : " ");
+    }
+    if (!logger->options.suppress_time) {
+        if (color)
+            _logmod_buffer_puts(buf, _LOGMOD_ENCODE_OPEN(UNDERLINE,
+                                                         FOREGROUND, WHITE));
+        _logmod_buffer_puts(buf, record->time);
+        _logmod_buffer_puts(buf, color ? _LOGMOD_ENCODE_CLOSE " " : " ");
+    }
+    if (logger->identity_cached) {
+        _logmod_buffer_write(buf,
+                             logger->identity
+                                 + (color ? logger->identity_length[0] : 0),
+                             logger->identity_length[color ? 1 : 0]);
+    }
+    else {
+        logmod_err code = _logmod_render_identity(logger, color, buf);
+        if (code != LOGMOD_OK) return code;
+    }
+    if (color) {
+        _logmod_buffer_puts(buf, "\x1b[");
+        _logmod_buffer_puts(buf, info->label->style);
+        _logmod_buffer_puts(buf, ";");
+        _logmod_buffer_puts(buf, info->label->visibility);
+        _logmod_buffer_puts(buf, info->label->color);
+        _logmod_buffer_puts(buf, "m");
+        _logmod_buffer_puts(buf, info->label->name);
+        _logmod_buffer_puts(buf, _LOGMOD_ENCODE_CLOSE
+                            " " _LOGMOD_ENCODE_OPEN(REGULAR, FOREGROUND,
+                                                    YELLOW));
+        _logmod_buffer_puts(buf, info->filename);
+        _logmod_buffer_puts(buf, _LOGMOD_ENCODE_CLOSE LMS(
+                                     BOLD, FOREGROUND, WHITE, ":")
+                                     _LOGMOD_ENCODE_OPEN(REGULAR, FOREGROUND,
+                                                         WHITE));
+        _logmod_buffer_long(buf, (long)info->line, 0);
+        _logmod_buffer_puts(buf, _LOGMOD_ENCODE_CLOSE ": ");
+    }
+    else {
+        _logmod_buffer_puts(buf, info->label->name);
+        _logmod_buffer_puts(buf, " ");
+        _logmod_buffer_puts(buf, info->filename);
+        _logmod_buffer_puts(buf, ":");
+        _logmod_buffer_long(buf, (long)info->line, 0);
+        _logmod_buffer_puts(buf, ": ");
+    }
+    return LOGMOD_OK;
+}
+
+#undef _LOGMOD_ENCODE_OPEN
+#undef _LOGMOD_ENCODE_CLOSE
+
+static logmod_err
+_logmod_message_format(struct _logmod_message *message,
+                       const char *fmt,
+                       va_list args)
+{
+    message->body.data = message->data + LOGMOD_PREFIX_SIZE;
+    message->body.size = LOGMOD_BUFFER_SIZE;
+    message->body.length = 0;
+    message->body.overflow = 0;
+    return _logmod_buffer_format(&message->body, fmt, args);
+}
+
+/**
+ * @brief Lay out a record's text line in place, its rendered prefix ahead
+ * of the message body, and a newline instead of the body's terminator
+ *
+ * @note The terminator must be restored once the line has been written
+ */
+static logmod_err
+_logmod_record_line(const struct logmod_logger *logger,
+                    struct _logmod_record *record,
+                    const int color,
+                    char **line,
+                    size_t *length)
+{
+    struct _logmod_buffer *body = &record->message.body;
+    char prefix_data[LOGMOD_PREFIX_SIZE];
+    struct _logmod_buffer prefix;
+    logmod_err code;
+
+    prefix.data = prefix_data;
+    prefix.size = sizeof prefix_data;
+    prefix.length = 0;
+    prefix.overflow = 0;
+    if ((code = _logmod_render_prefix(logger, record, color, &prefix))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    *line = body->data - prefix.length;
+    memcpy(*line, prefix.data, prefix.length);
+    body->data[body->length] = '\n';
+    *length = prefix.length + body->length + 1;
+    return LOGMOD_OK;
+}
+
+static logmod_err
+_logmod_print(const struct logmod_logger *logger,
+              struct _logmod_record *record,
+              const int color,
+              FILE *output)
+{
+    struct _logmod_buffer *body = &record->message.body;
+    size_t length;
+    char *line;
+    logmod_err code;
+
+    if ((code = _logmod_record_line(logger, record, color, &line, &length))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+
+    if (!body->overflow) {
+        code = fwrite(line, 1, length, output) == length ? LOGMOD_OK
+                                                         : LOGMOD_ERRNO;
+        body->data[body->length] = '\0';
+        LOGMOD_EXPECT(code == LOGMOD_OK, LOGMOD_ERRNO);
+        record->printed = length;
+    }
+    else { /* message doesn't fit the buffer, stream it instead */
+        const size_t prefix_length = length - body->length - 1;
+        va_list args;
+        int message_length;
+        body->data[body->length] = '\0';
+        LOGMOD_EXPECT(fwrite(line, 1, prefix_length, output) == prefix_length,
+                      LOGMOD_ERRNO);
+        LOGMOD_VA_COPY(args, *record->args);
+        message_length = vfprintf(output, record->fmt, args);
+        va_end(args);
+        LOGMOD_EXPECT(message_length >= 0, LOGMOD_ERRNO);
+        LOGMOD_EXPECT(putc('\n', output) != EOF, LOGMOD_ERRNO);
+        record->printed = prefix_length + (size_t)message_length + 1;
+    }
+    return LOGMOD_OK;
+}
+
+static struct logmod g_logmod;
+
+/** global logger used as a fallback */
+static struct logmod_logger g_loggers[] = {
+    {
+        0,
+        0,
+        0,
+        { 0 },
+        { NULL },
+        LOGMOD_FALLBACK_CONTEXT_ID,
+        0,
+        0,
+        0,
+        &g_logmod.counter,
+        { NULL, 0, 1 },
+        NULL,
+        NULL,
+        default_labels,
+        0,
+    },
+};
+/** global logmod used as a fallback */
+static struct logmod g_logmod = {
+    LOGMOD_FALLBACK_APPLICATION_ID,
+    g_loggers,
+    sizeof(g_loggers) / sizeof *g_loggers,
+    sizeof(g_loggers) / sizeof *g_loggers,
+    { NULL, 0, 1 },
+    _logmod_lock_noop,
+};
+
+#define LOGMOD_NSEC_PER_SEC 1000000000UL
+
+/** @brief CPU timestamp counter reading, if available */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LOGMOD_TSC() ((logmod_uint64)__builtin_ia32_rdtsc())
+#endif
+
+#ifndef LOGMOD_TSC_CALIBRATION_NSEC
+/** @brief How long to sample the TSC against the monotonic clock */
+#define LOGMOD_TSC_CALIBRATION_NSEC 10000000UL
+#endif
+
+#if defined(CLOCK_REALTIME)
+static logmod_uint64
+_logmod_clock_read(const clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (logmod_uint64)ts.tv_sec * LOGMOD_NSEC_PER_SEC
+           + (logmod_uint64)ts.tv_nsec;
+}
+#endif /* CLOCK_REALTIME */
+
+static logmod_uint64
+_logmod_clock_realtime(void)
+{
+#if defined(CLOCK_REALTIME)
+    return _logmod_clock_read(CLOCK_REALTIME);
+#else
+    return (logmod_uint64)time(NULL) * LOGMOD_NSEC_PER_SEC;
+#endif
+}
+
+static int
+_logmod_clock_supported(const unsigned source)
+{
+    switch (source) {
+    case LOGMOD_CLOCK_REALTIME:
+        return 1;
+#if defined(CLOCK_REALTIME_COARSE)
+    case LOGMOD_CLOCK_REALTIME_COARSE:
+        return 1;
+#endif
+#if defined(CLOCK_MONOTONIC)
+    case LOGMOD_CLOCK_MONOTONIC:
+        return 1;
+#if defined(LOGMOD_TSC)
+    case LOGMOD_CLOCK_TSC:
+        return 1;
+#endif
+#endif /* CLOCK_MONOTONIC */
+    default:
+        return 0;
+    }
+}
+
+/** @brief Read the logmod's clock source, in nanoseconds since the epoch */
+static logmod_uint64
+_logmod_clock_now(const struct logmod *logmod)
+{
+    const struct logmod_clock *clock_state = &logmod->clock;
+    switch (clock_state->source) {
+#if defined(CLOCK_REALTIME_COARSE)
+    case LOGMOD_CLOCK_REALTIME_COARSE:
+        return _logmod_clock_read(CLOCK_REALTIME_COARSE);
+#endif
+#if defined(CLOCK_MONOTONIC)
+    case LOGMOD_CLOCK_MONOTONIC:
+        return clock_state->base
+               + (_logmod_clock_read(CLOCK_MONOTONIC)
+                  - clock_state->base_ticks);
+#if defined(LOGMOD_TSC)
+    case LOGMOD_CLOCK_TSC:
+        return clock_state->base
+               + (logmod_uint64)((double)(LOGMOD_TSC()
+                                          - clock_state->base_ticks)
+                                 * clock_state->ns_per_tick);
+#endif
+#endif /* CLOCK_MONOTONIC */
+    default:
+        return _logmod_clock_realtime();
+    }
+}
+
+LOGMOD_API logmod_err
+logmod_set_clock(struct logmod *logmod, enum logmod_clocks source)
+{
+    struct logmod_clock *mut_clock = (struct logmod_clock *)&logmod->clock;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(_logmod_clock_supported(source), LOGMOD_BAD_PARAMETER);
+    mut_clock->base_ticks = 0;
+    mut_clock->ns_per_tick = 1.0;
+    switch (source) {
+#if defined(CLOCK_MONOTONIC)
+    case LOGMOD_CLOCK_MONOTONIC:
+        mut_clock->base_ticks = _logmod_clock_read(CLOCK_MONOTONIC);
+        break;
+#if defined(LOGMOD_TSC)
+    case LOGMOD_CLOCK_TSC: {
+        const logmod_uint64 start = _logmod_clock_read(CLOCK_MONOTONIC),
+                            start_ticks = LOGMOD_TSC();
+        logmod_uint64 end;
+        do {
+            end = _logmod_clock_read(CLOCK_MONOTONIC);
+        } while (end - start < LOGMOD_TSC_CALIBRATION_NSEC);
+        mut_clock->ns_per_tick =
+            (double)(end - start) / (double)(LOGMOD_TSC() - start_ticks);
+        mut_clock->base_ticks = LOGMOD_TSC();
+    } break;
+#endif
+#endif /* CLOCK_MONOTONIC */
+    default:
+        break;
+    }
+    mut_clock->base = _logmod_clock_realtime();
+    mut_clock->source = source;
+    return LOGMOD_OK;
+}
+
+/**
+ * @brief Thread-safe conversion of calendar time to local or UTC time
+ *
+ * Falls back to localtime()/gmtime() under the user-supplied lock when no
+ * reentrant version is available
+ */
+static void
+_logmod_calendar_time(const struct logmod *logmod,
+                      const time_t *time_raw,
+                      const int utc,
+                      struct tm *tm)
+{
+#if defined(_MSC_VER)
+    (void)logmod;
+    if (utc)
+        gmtime_s(tm, time_raw);
+    else
+        localtime_s(tm, time_raw);
+#elif defined(_POSIX_C_SOURCE) || defined(_POSIX_SOURCE)                     \
+    || defined(__APPLE__)
+    (void)logmod;
+    if (utc)
+        gmtime_r(time_raw, tm);
+    else
+        localtime_r(time_raw, tm);
+#else
+    logmod->lock(NULL, 1);
+    *tm = utc ? *gmtime(time_raw) : *localtime(time_raw);
+    logmod->lock(NULL, 0);
+#endif
+}
+
+/** @brief Write `value` as `width` zero-padded decimal digits */
+static void
+_logmod_render_digits(char *dest, unsigned long value, int width)
+{
+    while (width--) {
+        dest[width] = (char)('0' + value % 10);
+        value /= 10;
+    }
+}
+
+/**
+ * @brief Render time `tm`, `offset` minutes east of UTC, as
+ * YYYY-MM-DDTHH:MM:SS+hh:mm
+ */
+static void
+_logmod_time_format(const struct tm *tm,
+                    long offset,
+                    char text[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"])
+{
+    _logmod_render_digits(text, (unsigned long)tm->tm_year + 1900, 4);
+    text[4] = '-';
+    _logmod_render_digits(text + 5, (unsigned long)tm->tm_mon + 1, 2);
+    text[7] = '-';
+    _logmod_render_digits(text + 8, (unsigned long)tm->tm_mday, 2);
+    text[10] = 'T';
+    _logmod_render_digits(text + 11, (unsigned long)tm->tm_hour, 2);
+    text[13] = ':';
+    _logmod_render_digits(text + 14, (unsigned long)tm->tm_min, 2);
+    text[16] = ':';
+    _logmod_render_digits(text + 17, (unsigned long)tm->tm_sec, 2);
+    text[19] = offset < 0 ? '-' : '+';
+    if (offset < 0) offset = -offset;
+    _logmod_render_digits(text + 20, (unsigned long)offset / 60, 2);
+    text[22] = ':';
+    _logmod_render_digits(text + 23, (unsigned long)offset % 60, 2);
+    text[25] = '\0';
+}
+
+/** @brief Render local time `tm` as YYYY-MM-DDTHH:MM:SS+hh:mm */
+static void
+_logmod_time_render(const struct logmod *logmod,
+                    const time_t *time_raw,
+                    const struct tm *tm,
+                    char text[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"])
+{
+    struct tm utc;
+    long offset;
+    _logmod_calendar_time(logmod, time_raw, 1, &utc);
+    offset = (tm->tm_hour - utc.tm_hour) * 60L + (tm->tm_min - utc.tm_min);
+    if (tm->tm_year != utc.tm_year)
+        offset += tm->tm_year > utc.tm_year ? 24 * 60L : -24 * 60L;
+    else
+        offset += (tm->tm_yday - utc.tm_yday) * 24 * 60L;
+    _logmod_time_format(tm, offset, text);
+}
+
+/**
+ * @brief Get the local time for `time_raw` from the logmod's time cache
+ *
+ * The cache is only converted again when the calendar second changes (which
+ * also covers wall-clock jumps). Readers never block: if the cache is being
+ * updated by another thread, the time is converted locally instead.
+ */
+static void
+_logmod_time_get(struct logmod *logmod,
+                 const time_t time_raw,
+                 struct tm *tm,
+                 char text[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"])
+{
+    struct logmod_time_cache *cache = &logmod->time_cache;
+#ifdef LOGMOD_ATOMICS
+    unsigned long generation =
+        LOGMOD_ATOMIC_LOAD(unsigned long, &cache->generation);
+    if (!(generation & 1) && cache->second == time_raw) {
+        *tm = cache->tm;
+        memcpy(text, cache->text, sizeof cache->text);
+        LOGMOD_ATOMIC_FENCE();
+        if (generation
+            == LOGMOD_ATOMIC_LOAD(unsigned long, &cache->generation))
+        {
+            return;
+        }
+    }
+    _logmod_calendar_time(logmod, &time_raw, 0, tm);
+    _logmod_time_render(logmod, &time_raw, tm, text);
+    if (!(generation & 1)
+        && LOGMOD_ATOMIC_CAS(unsigned long, &cache->generation, &generation,
+                             generation + 1))
+    {
+        cache->second = time_raw;
+        cache->tm = *tm;
+        memcpy(cache->text, text, sizeof cache->text);
+        LOGMOD_ATOMIC_STORE(unsigned long, &cache->generation,
+                            generation + 2);
+    }
+#else
+    int hit;
+    logmod->lock(NULL, 1);
+    if ((hit = cache->generation != 0 && cache->second == time_raw)) {
+        *tm = cache->tm;
+        memcpy(text, cache->text, sizeof cache->text);
+    }
+    logmod->lock(NULL, 0);
+    if (!hit) {
+        _logmod_calendar_time(logmod, &time_raw, 0, tm);
+        _logmod_time_render(logmod, &time_raw, tm, text);
+        logmod->lock(NULL, 1);
+        cache->second = time_raw;
+        cache->tm = *tm;
+        memcpy(cache->text, text, sizeof cache->text);
+        cache->generation = 2;
+        logmod->lock(NULL, 0);
+    }
+#endif /* LOGMOD_ATOMICS */
+}
+
+/** @brief Render the record's time according to the logger's time format */
+static void
+_logmod_record_time_render(struct _logmod_record *record,
+                           const unsigned time_format,
+                           const char *cached)
+{
+    const unsigned long usec = (unsigned long)(record->info.timestamp
+                                               % LOGMOD_NSEC_PER_SEC)
+                               / 1000;
+    char *text = record->time;
+    if (time_format == LOGMOD_TIME_ISO8601) {
+        memcpy(text, cached, 19);
+        text += 19;
+    }
+    else {
+        memcpy(text, cached + 11, 8);
+        text += 8;
+    }
+    if (time_format == LOGMOD_TIME_HMS_USEC
+        || time_format == LOGMOD_TIME_ISO8601)
+    {
+        *text++ = '.';
+        _logmod_render_digits(text, usec, 6);
+        text += 6;
+    }
+    if (time_format == LOGMOD_TIME_ISO8601) {
+        memcpy(text, cached + 19, 6);
+        text += 6;
+    }
+    *text = '\0';
+}
+
+/** @brief Take the next sequence number from the global message counter */
+static long
+_logmod_counter_next(struct logmod *logmod, const struct logmod_logger *logger)
+{
+#ifdef LOGMOD_ATOMICS
+    (void)logger;
+    return LOGMOD_ATOMIC_FETCH_ADD(long, &logmod->counter, 1);
+#else
+    long counter;
+    logmod->lock(logger, 1);
+    counter = logmod->counter++;
+    logmod->lock(logger, 0);
+    return counter;
+#endif
+}
+
+static void
+_logmod_record_populate(struct _logmod_record *record,
+                        const struct logmod_label *label,
+                        const unsigned line,
+                        const char *const filename,
+                        const unsigned level,
+                        const long counter,
+                        const logmod_uint64 timestamp)
+{
+    struct logmod_info *info = &record->info;
+    unsigned *mut_line = (unsigned *)&info->line;
+    const char **mut_filename = (const char **)&info->filename;
+    unsigned *mut_level = (unsigned *)&info->level;
+    const struct logmod_label **mut_label =
+        (const struct logmod_label **)&info->label;
+    logmod_uint64 *mut_timestamp = (logmod_uint64 *)&info->timestamp;
+    long *mut_counter = (long *)&info->counter;
+    const char **mut_message = (const char **)&info->message;
+    *mut_line = line;
+    *mut_filename = filename;
+    *mut_level = level;
+    *mut_label = label;
+    *mut_message = record->message.body.data;
+    *mut_counter = counter;
+    *mut_timestamp = timestamp;
+}
+
+/** @brief Convert the record's timestamp to local time, and render it */
+static void
+_logmod_record_localize(struct _logmod_record *record,
+                        const struct logmod_logger *logger)
+{
+    struct tm *mut_time = (struct tm *)&record->info.time;
+    char cached[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"];
+    _logmod_time_get(LOGMOD_FROM_LOGGER(logger),
+                     (time_t)(record->info.timestamp / LOGMOD_NSEC_PER_SEC),
+                     mut_time, cached);
+    _logmod_record_time_render(record, logger->options.time_format, cached);
+    record->utc_offset = ((cached[20] - '0') * 10 + (cached[21] - '0')) * 60
+                         + (cached[23] - '0') * 10 + (cached[24] - '0');
+    if (cached[19] == '-') record->utc_offset = -record->utc_offset;
+}
+
+/** @brief Format the message body from the packed arguments, if not yet */
+static void
+_logmod_record_format(struct _logmod_record *record)
+{
+    if (!record->formatted) {
+        _logmod_args_render(&record->message.body, record->fmt,
+                            record->packed, record->packed_length);
+        /* arguments can't be streamed anymore, keep it truncated */
+        record->message.body.overflow = 0;
+        record->formatted = 1;
+    }
+}
+
+/** @brief If 1, the flush policy may hold records back */
+#define _LOGMOD_FLUSH_BATCHED(_policy)                                        \
+    ((_policy)->records || (_policy)->bytes || (_policy)->interval_ms         \
+     || (_policy)->level)
+
+/**
+ * @brief Account for a record written to a file
+ *
+ * @return 1 if the file should now be flushed, as per the flush policy
+ */
+static int
+_logmod_flush_account(const struct logmod_flush_policy *policy,
+                      struct logmod_flush_state *pending,
+                      const struct _logmod_record *record,
+                      const size_t length)
+{
+    const logmod_uint64 timestamp = record->info.timestamp;
+    if (!pending->records) pending->since = timestamp;
+    ++pending->records;
+    pending->bytes += length;
+    return (policy->level && record->info.level >= policy->level)
+           || (policy->records && pending->records >= policy->records)
+           || (policy->bytes && pending->bytes >= policy->bytes)
+           || (policy->interval_ms
+               && timestamp >= pending->since
+                                   + (logmod_uint64)policy->interval_ms
+                                         * (LOGMOD_NSEC_PER_SEC / 1000));
+}
+
+/** @brief Flush a record written to the logfile, as per the flush policy */
+static logmod_err
+_logmod_logfile_flush(const struct logmod_logger *logger,
+                      const struct _logmod_record *record)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod *logmod;
+    int failed = 0;
+
+    if (!_LOGMOD_FLUSH_BATCHED(&logger->options.flush)) {
+        LOGMOD_EXPECT(fflush(logger->options.logfile) != EOF, LOGMOD_ERRNO);
+        return LOGMOD_OK;
+    }
+    logmod = LOGMOD_FROM_LOGGER(logger);
+    logmod->lock(logger, 1);
+    if (_logmod_flush_account(&logger->options.flush, &mut_logger->pending,
+                              record, record->printed))
+    {
+        failed = fflush(logger->options.logfile) == EOF;
+        memset(&mut_logger->pending, 0, sizeof mut_logger->pending);
+    }
+    logmod->lock(logger, 0);
+    LOGMOD_EXPECT(!failed, LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+
+/** @brief Write `str` as a JSON string, unless it doesn't fit entirely */
+static void
+_logmod_buffer_json(struct _logmod_buffer *buf, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *c = (const unsigned char *)str;
+    _logmod_buffer_write(buf, "\"", 1);
+    for (; *c && !buf->overflow; ++c) {
+        char escape[6] = { '\\', 0, '0', '0', 0, 0 };
+        size_t length = 2;
+        if (*c == '"' || *c == '\\')
+            escape[1] = (char)*c;
+        else if (*c == '\n')
+            escape[1] = 'n';
+        else if (*c == '\t')
+            escape[1] = 't';
+        else if (*c == '\r')
+            escape[1] = 'r';
+        else if (*c < 0x20) {
+            escape[1] = 'u';
+            escape[4] = hex[*c >> 4];
+            escape[5] = hex[*c & 0xf];
+            length = 6;
+        }
+        else { /* copy up to the next character to escape */
+            const unsigned char *end = c;
+            while (end[1] >= 0x20 && end[1] != '"' && end[1] != '\\')
+                ++end;
+            _logmod_buffer_write(buf, (const char *)c, (size_t)(end - c) + 1);
+            c = end;
+            continue;
+        }
+        if (buf->size - 1 - buf->length < length)
+            buf->overflow = 1;
+        else
+            _logmod_buffer_write(buf, escape, length);
+    }
+    _logmod_buffer_write(buf, "\"", 1);
+}
+
+/** @brief Render a record as a line holding a JSON object */
+static void
+_logmod_render_structured(const struct logmod_logger *logger,
+                          struct _logmod_record *record,
+                          struct _logmod_buffer *buf)
+{
+    /* room for closing the object, if the message is truncated */
+    static const size_t reserved = sizeof "\"}\n";
+    const struct logmod_info *info = &record->info;
+    char digits[24], *start = digits + sizeof digits;
+
+    buf->size -= reserved;
+    _logmod_buffer_puts(buf, "{\"counter\":");
+    _logmod_buffer_long(buf, info->counter, 0);
+    _logmod_buffer_puts(buf, ",\"timestamp\":");
+    start = _logmod_render_decimal(start, info->timestamp);
+    _logmod_buffer_write(buf, start, (size_t)(digits + sizeof digits - start));
+    _logmod_buffer_puts(buf, ",\"time\":");
+    _logmod_buffer_json(buf, record->time);
+    _logmod_buffer_puts(buf, ",\"level\":");
+    _logmod_buffer_json(buf, info->label->name);
+    _logmod_buffer_puts(buf, ",\"application\":");
+    _logmod_buffer_json(buf, LOGMOD_FROM_LOGGER(logger)->application_id);
+    _logmod_buffer_puts(buf, ",\"context\":");
+    _logmod_buffer_json(buf, logger->context_id);
+    _logmod_buffer_puts(buf, ",\"file\":");
+    _logmod_buffer_json(buf, info->filename);
+    _logmod_buffer_puts(buf, ",\"line\":");
+    _logmod_buffer_long(buf, (long)info->line, 0);
+    _logmod_buffer_puts(buf, ",\"message\":");
+    _logmod_buffer_json(buf, record->message.body.data);
+    if (buf->overflow) { /* close the truncated string */
+        buf->size += 1;
+        _logmod_buffer_write(buf, "\"", 1);
+        buf->size -= 1;
+    }
+    buf->size += reserved;
+    _logmod_buffer_puts(buf, "}\n");
+}
+
+/** @brief Strings at least this long are written in place as segments */
+#define _LOGMOD_SEGMENT_MIN 256
+
+/**
+ * @brief Append a piece to `segments`, extending the last one if adjacent
+ *
+ * @return 0 if there are already LOGMOD_MAX_SEGMENTS segments
+ */
+static int
+_logmod_segment_add(struct logmod_segment segments[],
+                    unsigned *count,
+                    const char *data,
+                    const size_t length)
+{
+    struct logmod_segment *last = *count ? &segments[*count - 1] : NULL;
+    if (!length) return 1;
+    if (last && last->data + last->length == data) {
+        last->length += length;
+        return 1;
+    }
+    if (*count == LOGMOD_MAX_SEGMENTS) return 0;
+    segments[*count].data = data;
+    segments[*count].length = length;
+    ++*count;
+    return 1;
+}
+
+/**
+ * @brief Split a message too large for the record buffer into segments,
+ * followed by a newline
+ *
+ * `%s` strings of at least _LOGMOD_SEGMENT_MIN bytes are referenced in
+ * place, everything else is rendered into `scratch`.
+ *
+ * @return 1 on success, 0 if the message needs more segments or scratch
+ * room, or has conversions whose arguments aren't known
+ */
+static int
+_logmod_message_segments(const char *fmt,
+                         va_list args,
+                         struct _logmod_buffer *scratch,
+                         struct logmod_segment segments[],
+                         unsigned *count)
+{
+    struct _logmod_spec spec;
+    size_t start;
+    int fits = 1;
+    va_list ap;
+
+    LOGMOD_VA_COPY(ap, args);
+    while (fits && _logmod_spec_parse(fmt, &spec)) {
+        union _logmod_arg arg;
+        int stars[2];
+        size_t length;
+        if (spec.type == _LOGMOD_ARG_UNSUPPORTED) {
+            fits = 0;
+            break;
+        }
+        start = scratch->length;
+        _logmod_buffer_write(scratch, fmt, (size_t)(spec.start - fmt));
+        _logmod_arg_read(&spec, &ap, stars, &arg);
+        if (spec.type == _LOGMOD_ARG_STRING && spec.end - spec.start == 2
+            && arg.string
+            && (length = strlen(arg.string)) >= _LOGMOD_SEGMENT_MIN)
+        {
+            fits = _logmod_segment_add(segments, count, scratch->data + start,
+                                       scratch->length - start)
+                   && _logmod_segment_add(segments, count, arg.string,
+                                          length);
+        }
+        else {
+            _logmod_spec_render(scratch, &spec, stars, &arg);
+            fits = _logmod_segment_add(segments, count, scratch->data + start,
+                                       scratch->length - start);
+        }
+        fmt = spec.end;
+    }
+    if (fits) {
+        start = scratch->length;
+        _logmod_buffer_puts(scratch, fmt);
+        _logmod_buffer_write(scratch, "\n", 1);
+        fits = _logmod_segment_add(segments, count, scratch->data + start,
+                                   scratch->length - start);
+    }
+    va_end(ap);
+    return fits && !scratch->overflow;
+}
+
+/**
+ * @brief Render a record's text line as segments: its prefix into
+ * `prefix`, then its message body and a newline
+ *
+ * Messages too large for the record buffer are split by
+ * _logmod_message_segments() while their arguments are available, instead
+ * of being truncated.
+ */
+static logmod_err
+_logmod_record_segments(const struct logmod_logger *logger,
+                        const struct _logmod_record *record,
+                        const int color,
+                        struct _logmod_buffer *prefix,
+                        struct _logmod_buffer *scratch,
+                        struct logmod_segment segments[],
+                        unsigned *count)
+{
+    const struct _logmod_buffer *body = &record->message.body;
+    logmod_err code;
+
+    if ((code = _logmod_render_prefix(logger, record, color, prefix))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    *count = 0;
+    _logmod_segment_add(segments, count, prefix->data, prefix->length);
+    if (body->overflow && record->args
+        && _logmod_message_segments(record->fmt, *record->args, scratch,
+                                    segments, count))
+    {
+        return LOGMOD_OK;
+    }
+    *count = prefix->length ? 1 : 0;
+    _logmod_segment_add(segments, count, body->data, body->length);
+    _logmod_segment_add(segments, count, "\n", 1);
+    return LOGMOD_OK;
+}
+
+/** @brief Write a record to a sink, and flush it as per its flush policy */
+static logmod_err
+_logmod_sink_write(const struct logmod_logger *logger,
+                   struct logmod_sink *sink,
+                   struct _logmod_record *record)
+{
+    struct logmod *logmod;
+    logmod_err code;
+    size_t length;
+    int flush;
+
+    if (sink->format == LOGMOD_SINK_STRUCTURED) {
+        char data[LOGMOD_PREFIX_SIZE + LOGMOD_BUFFER_SIZE];
+        struct _logmod_buffer buf;
+        buf.data = data;
+        buf.size = sizeof data;
+        buf.length = 0;
+        buf.overflow = 0;
+        _logmod_render_structured(logger, record, &buf);
+        length = buf.length;
+        code = sink->vtable->write(sink, &record->info, data, length);
+    }
+    else if (sink->vtable->writev) {
+        struct logmod_segment segments[LOGMOD_MAX_SEGMENTS];
+        char prefix_data[LOGMOD_PREFIX_SIZE], scratch_data[LOGMOD_BUFFER_SIZE];
+        struct _logmod_buffer prefix, scratch;
+        unsigned count, i;
+        prefix.data = prefix_data;
+        prefix.size = sizeof prefix_data;
+        scratch.data = scratch_data;
+        scratch.size = sizeof scratch_data;
+        prefix.length = scratch.length = 0;
+        prefix.overflow = scratch.overflow = 0;
+        code = _logmod_record_segments(logger, record,
+                                       sink->format == LOGMOD_SINK_COLOR,
+                                       &prefix, &scratch, segments, &count);
+        if (code != LOGMOD_OK) return code;
+        for (i = 0, length = 0; i < count; ++i)
+            length += segments[i].length;
+        code = sink->vtable->writev(sink, &record->info, segments, count);
+    }
+    else {
+        char *line;
+        code = _logmod_record_line(logger, record,
+                                   sink->format == LOGMOD_SINK_COLOR, &line,
+                                   &length);
+        if (code != LOGMOD_OK) return code;
+        code = sink->vtable->write(sink, &record->info, line, length);
+        record->message.body.data[record->message.body.length] = '\0';
+    }
+    if (code != LOGMOD_OK || !sink->vtable->flush) return code;
+    if (!_LOGMOD_FLUSH_BATCHED(&sink->flush)) return sink->vtable->flush(sink);
+
+    logmod = LOGMOD_FROM_LOGGER(logger);
+    logmod->lock(logger, 1);
+    flush = _logmod_flush_account(&sink->flush, &sink->pending, record, length);
+    if (flush) {
+        code = sink->vtable->flush(sink);
+        memset(&sink->pending, 0, sizeof sink->pending);
+    }
+    logmod->lock(logger, 0);
+    return code;
+}
+
+/**
+ * @brief Dispatch a record to the logger's sinks that take its level
+ *
+ * @return LOGMOD_OK_CONTINUE if no sink takes it
+ */
+static logmod_err
+_logmod_sinks_write(const struct logmod_logger *logger,
+                    struct _logmod_record *record)
+{
+    const unsigned level = record->info.level;
+    unsigned mask = _LOGMOD_SINK_MASK(logger, level);
+    logmod_err code = LOGMOD_OK_CONTINUE;
+    unsigned i;
+
+    if (!mask) return code;
+    _logmod_record_format(record);
+    for (i = 0, code = LOGMOD_OK; mask; ++i, mask >>= 1) {
+        if (mask & 1) {
+            const logmod_err sink_code =
+                _logmod_sink_write(logger, logger->sinks[i], record);
+            if (sink_code != LOGMOD_OK) code = sink_code;
+        }
+    }
+    return code;
+}
+
+#ifdef LOGMOD_ROTATING_SINK
+#ifndef LOGMOD_ATOMICS
+#error "LOGMOD_ROTATING_SINK requires atomic operations (GCC, Clang or C11)"
+#endif
+
+/** @brief Path of rotated file `index`, or of the active file if 0 */
+static const char *
+_logmod_rotation_path(const struct logmod_rotation *rotation,
+                      unsigned index,
+                      char path[LOGMOD_PATH_SIZE])
+{
+    struct _logmod_buffer buf;
+    buf.data = path;
+    buf.size = LOGMOD_PATH_SIZE;
+    buf.length = 0;
+    buf.overflow = 0;
+    _logmod_buffer_puts(&buf, rotation->path);
+    if (index) {
+        _logmod_buffer_puts(&buf, ".");
+        _logmod_buffer_long(&buf, (long)index, 0);
+    }
+    path[buf.length] = '\0';
+    return path;
+}
+
+/** @brief Timestamp of the next multiple of the rotation interval */
+static logmod_uint64
+_logmod_rotation_deadline(const struct logmod_rotation *rotation,
+                          logmod_uint64 now)
+{
+    const logmod_uint64 interval =
+        (logmod_uint64)rotation->policy.interval_s * LOGMOD_NSEC_PER_SEC;
+    return interval ? (now / interval + 1) * interval : 0;
+}
+
+/**
+ * @brief Rotate the file
+ *
+ * Records written meanwhile go to the old file, under its new name.
+ */
+static void *
+_logmod_rotation_main(void *arg)
+{
+    struct logmod_sink *sink = arg;
+    struct logmod_rotation *rotation = sink->data;
+    char from[LOGMOD_PATH_SIZE], to[LOGMOD_PATH_SIZE];
+    unsigned i = rotation->policy.keep;
+    int fd;
+
+    /* retried at the next limit if anything fails */
+    LOGMOD_ATOMIC_STORE(size_t, &rotation->written, 0);
+    LOGMOD_ATOMIC_STORE(
+        logmod_uint64, &rotation->deadline,
+        _logmod_rotation_deadline(rotation, _logmod_clock_realtime()));
+
+    if (i) {
+        unlink(_logmod_rotation_path(rotation, i, to));
+        for (; i > 0; --i) {
+            rename(_logmod_rotation_path(rotation, i - 1, from),
+                   _logmod_rotation_path(rotation, i, to));
+        }
+    }
+    else {
+        unlink(rotation->path);
+    }
+    fd = open(rotation->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+        dup2(fd, sink->fd); /* swaps files for every thread at once */
+        close(fd);
+    }
+    LOGMOD_ATOMIC_STORE(int, &rotation->state, 0);
+    return NULL;
+}
+
+/**
+ * @brief Start a rotation on a helper thread, or rotate right away if it
+ * can't be created
+ *
+ * Only called by the thread that set `state`, so the previous helper is
+ * done with the rotation and no other thread touches `helper`.
+ */
+static void
+_logmod_rotation_start(struct logmod_sink *sink)
+{
+    struct logmod_rotation *rotation = sink->data;
+    if (rotation->joinable) pthread_join(rotation->helper, NULL);
+    rotation->joinable = (0
+                          == pthread_create(&rotation->helper, NULL,
+                                            &_logmod_rotation_main, sink));
+    if (!rotation->joinable) _logmod_rotation_main(sink);
+}
+
+static logmod_err
+_logmod_rotating_sink_writev(struct logmod_sink *sink,
+                             const struct logmod_info *info,
+                             const struct logmod_segment segments[],
+                             unsigned count)
+{
+    struct logmod_rotation *rotation = sink->data;
+    const logmod_uint64 deadline =
+        LOGMOD_ATOMIC_LOAD(logmod_uint64, &rotation->deadline);
+    size_t length = 0, written;
+    logmod_err code;
+    unsigned i;
+
+    if ((code = _logmod_fd_sink_writev(sink, info, segments, count))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    for (i = 0; i < count; ++i)
+        length += segments[i].length;
+    written = LOGMOD_ATOMIC_FETCH_ADD(size_t, &rotation->written, length)
+              + length;
+    if ((rotation->policy.max_bytes && written >= rotation->policy.max_bytes)
+        || (deadline && info->timestamp >= deadline))
+    {
+        int idle = 0; /* one rotation at a time */
+        if (LOGMOD_ATOMIC_CAS(int, &rotation->state, &idle, 1))
+            _logmod_rotation_start(sink);
+    }
+    return LOGMOD_OK;
+}
+
+static logmod_err
+_logmod_rotating_sink_write(struct logmod_sink *sink,
+                            const struct logmod_info *info,
+                            const char *line,
+                            size_t length)
+{
+    struct logmod_segment segment;
+    segment.data = line;
+    segment.length = length;
+    return _logmod_rotating_sink_writev(sink, info, &segment, 1);
+}
+
+static void
+_logmod_rotating_sink_close(struct logmod_sink *sink)
+{
+    struct logmod_rotation *rotation = sink->data;
+    if (rotation->joinable) pthread_join(rotation->helper, NULL);
+    rotation->joinable = 0;
+    close(sink->fd);
+}
+
+static const struct logmod_sink_vtable g_rotating_sink = {
+    _logmod_rotating_sink_write, NULL, _logmod_rotating_sink_close,
+    _logmod_rotating_sink_writev
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init_rotating(struct logmod_sink *sink,
+                          struct logmod_rotation *rotation,
+                          const char *path,
+                          struct logmod_rotation_policy policy,
+                          unsigned level,
+                          enum logmod_sink_formats format)
+{
+    struct stat st;
+    logmod_err code;
+    int fd;
+    LOGMOD_EXPECT(rotation != NULL && path != NULL, LOGMOD_BAD_PARAMETER);
+    /* room for the largest suffix */
+    LOGMOD_EXPECT(strlen(path) + sizeof ".4294967295" <= LOGMOD_PATH_SIZE,
+                  LOGMOD_BAD_PARAMETER);
+    if ((code = logmod_sink_init(sink, &g_rotating_sink, rotation, level,
+                                 format))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    LOGMOD_EXPECT(fd >= 0, LOGMOD_ERRNO);
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        LOGMOD_EXPECT(0, LOGMOD_ERRNO);
+    }
+    memset(rotation, 0, sizeof *rotation);
+    rotation->path = path;
+    rotation->policy = policy;
+    rotation->written = (size_t)st.st_size;
+    rotation->deadline =
+        _logmod_rotation_deadline(rotation, _logmod_clock_realtime());
+    sink->fd = fd;
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_ROTATING_SINK */
+
+#ifdef LOGMOD_DURABLE_SINK
+#if defined(__APPLE__) /* no fdatasync(), fsync() flushes metadata too */
+#define _LOGMOD_FDATASYNC(_fd) fsync(_fd)
+#else
+#define _LOGMOD_FDATASYNC(_fd) fdatasync(_fd)
+#endif
+
+/**
+ * @brief Record the outcome of the batch of records `first` to `last`
+ *
+ * Waits for the logging calls of the previous batch to read its outcome
+ * first, so that each call gets the one of its own batch.
+ *
+ * @param readers Logging calls left to read the outcome
+ */
+static void
+_logmod_durable_done(struct logmod_durable *durable,
+                     const unsigned long first,
+                     const unsigned long last,
+                     const int error,
+                     const unsigned long readers)
+{
+    while (durable->unread)
+        pthread_cond_wait(&durable->cond, &durable->mutex);
+    if (error) {
+        durable->failed += last - first + 1;
+        durable->error = error;
+    }
+    durable->batch_first = first;
+    durable->batch_error = error;
+    durable->unread = readers;
+    durable->committed = last;
+    durable->committing = 0;
+    ++durable->commits;
+    pthread_cond_broadcast(&durable->cond);
+}
+
+/**
+ * @brief Write `length` bytes, resuming partial writes
+ *
+ * Nothing is logged, as logging the failure could go through this sink.
+ *
+ * @return 0, or the errno of the write() that failed
+ */
+static int
+_logmod_durable_write(const int fd, const char *data, size_t length)
+{
+    while (length) {
+        const ssize_t written = write(fd, data, length);
+        if (written >= 0) {
+            data += written;
+            length -= (size_t)written;
+        }
+        else if (errno != EINTR) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Gather the batch being filled for up to `max_latency_us`, then
+ * write it out and wait for the disk
+ *
+ * Called with the mutex held, which is released meanwhile so that records
+ * can join the batch, then fill the other buffer.
+ */
+static void
+_logmod_durable_commit(struct logmod_durable *durable, const int fd)
+{
+    const char *batch;
+    unsigned long first, last;
+    size_t length;
+    int error;
+
+    durable->committing = 1;
+    if (durable->max_latency_us) {
+        const logmod_uint64 deadline =
+            _logmod_clock_realtime()
+            + (logmod_uint64)durable->max_latency_us * 1000;
+        struct timespec ts;
+        ts.tv_sec = (time_t)(deadline / LOGMOD_NSEC_PER_SEC);
+        ts.tv_nsec = (long)(deadline % LOGMOD_NSEC_PER_SEC);
+        while (!durable->full
+               && pthread_cond_timedwait(&durable->cond, &durable->mutex, &ts)
+                      == 0)
+            continue;
+    }
+    batch = durable->buffers + durable->current * durable->buffer_size;
+    length = durable->filled;
+    first = durable->committed + 1;
+    last = durable->appended;
+    durable->current ^= 1;
+    durable->filled = 0;
+    durable->full = 0;
+    pthread_cond_broadcast(&durable->cond); /* room in the other buffer */
+    pthread_mutex_unlock(&durable->mutex);
+
+    error = _logmod_durable_write(fd, batch, length);
+    if (!error && _LOGMOD_FDATASYNC(fd) != 0) error = errno;
+
+    pthread_mutex_lock(&durable->mutex);
+    _logmod_durable_done(durable, first, last, error, last - first + 1);
+}
+
+static logmod_err
+_logmod_durable_sink_writev(struct logmod_sink *sink,
+                            const struct logmod_info *info,
+                            const struct logmod_segment segments[],
+                            unsigned count)
+{
+    struct logmod_durable *durable = sink->data;
+    unsigned long number;
+    size_t length = 0;
+    unsigned i;
+    int error = 0;
+    (void)info;
+
+    for (i = 0; i < count; ++i)
+        length += segments[i].length;
+    pthread_mutex_lock(&durable->mutex);
+    while (durable->filled + length > durable->buffer_size) {
+        if (durable->committing) { /* wait for the batch to be swapped */
+            durable->full = 1;
+            pthread_cond_broadcast(&durable->cond);
+            pthread_cond_wait(&durable->cond, &durable->mutex);
+        }
+        else if (durable->filled) {
+            _logmod_durable_commit(durable, sink->fd);
+        }
+        else { /* larger than a buffer, every record before is committed */
+            number = ++durable->appended;
+            durable->committing = 1;
+            pthread_mutex_unlock(&durable->mutex);
+            for (i = 0; i < count && !error; ++i) {
+                error = _logmod_durable_write(sink->fd, segments[i].data,
+                                              segments[i].length);
+            }
+            if (!error && _LOGMOD_FDATASYNC(sink->fd) != 0) error = errno;
+            pthread_mutex_lock(&durable->mutex);
+            _logmod_durable_done(durable, number, number, error, 0);
+            pthread_mutex_unlock(&durable->mutex);
+            if (!error) return LOGMOD_OK;
+            errno = error;
+            return LOGMOD_ERRNO;
+        }
+    }
+    for (i = 0; i < count; ++i) {
+        memcpy(durable->buffers + durable->current * durable->buffer_size
+                   + durable->filled,
+               segments[i].data, segments[i].length);
+        durable->filled += segments[i].length;
+    }
+    number = ++durable->appended;
+
+    /* the first record to find no batch being committed commits its own */
+    while ((long)(number - durable->committed) > 0) {
+        if (durable->committing)
+            pthread_cond_wait(&durable->cond, &durable->mutex);
+        else
+            _logmod_durable_commit(durable, sink->fd);
+    }
+    /* the last batch committed is this record's, until it is read */
+    error = durable->batch_error;
+    if (--durable->unread == 0) pthread_cond_broadcast(&durable->cond);
+    pthread_mutex_unlock(&durable->mutex);
+    if (!error) return LOGMOD_OK;
+    errno = error;
+    return LOGMOD_ERRNO;
+}
+
+static logmod_err
+_logmod_durable_sink_write(struct logmod_sink *sink,
+                           const struct logmod_info *info,
+                           const char *line,
+                           size_t length)
+{
+    struct logmod_segment segment;
+    segment.data = line;
+    segment.length = length;
+    return _logmod_durable_sink_writev(sink, info, &segment, 1);
+}
+
+static void
+_logmod_durable_sink_close(struct logmod_sink *sink)
+{
+    struct logmod_durable *durable = sink->data;
+    pthread_cond_destroy(&durable->cond);
+    pthread_mutex_destroy(&durable->mutex);
+}
+
+static const struct logmod_sink_vtable g_durable_sink = {
+    _logmod_durable_sink_write, NULL, _logmod_durable_sink_close,
+    _logmod_durable_sink_writev
+};
+
+LOGMOD_API logmod_err
+logmod_sink_init_durable(struct logmod_sink *sink,
+                         struct logmod_durable *durable,
+                         int fd,
+                         char *buffers,
+                         size_t buffer_size,
+                         unsigned long max_latency_us,
+                         unsigned level,
+                         enum logmod_sink_formats format)
+{
+    logmod_err code;
+    LOGMOD_EXPECT(durable != NULL && fd >= 0, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(buffers != NULL && buffer_size > 0, LOGMOD_BAD_PARAMETER);
+    if ((code = logmod_sink_init(sink, &g_durable_sink, durable, level,
+                                 format))
+        != LOGMOD_OK)
+    {
+        return code;
+    }
+    memset(durable, 0, sizeof *durable);
+    pthread_mutex_init(&durable->mutex, NULL);
+    pthread_cond_init(&durable->cond, NULL);
+    durable->buffers = buffers;
+    durable->buffer_size = buffer_size;
+    durable->max_latency_us = max_latency_us;
+    sink->fd = fd;
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_DURABLE_SINK */
+
+/**
+ * @brief Whether records pending in a file or sink are due for flushing
+ *
+ * Otherwise, lowers `next` to the nanoseconds until they are due, if they
+ * have a flush interval.
+ */
+static int
+_logmod_flush_due(const struct logmod_flush_state *pending,
+                  const unsigned long interval_ms,
+                  const logmod_uint64 now,
+                  const int all,
+                  logmod_uint64 *next)
+{
+    const logmod_uint64 interval =
+        (logmod_uint64)interval_ms * (LOGMOD_NSEC_PER_SEC / 1000);
+    if (!pending->records) return 0;
+    if (all || (interval && now >= pending->since + interval)) return 1;
+    if (interval && (!*next || pending->since + interval - now < *next))
+        *next = pending->since + interval - now;
+    return 0;
+}
+
+/**
+ * @brief Flush a logger's logfile or binary stream, and sinks, if they hold
+ * records pending for longer than their flush interval, or any record if
+ * `all` is 1
+ *
+ * Every due output is flushed, even past a failure.
+ * @return LOGMOD_OK, or the error of the first output that failed to flush
+ */
+static logmod_err
+_logmod_logger_flush_pending(struct logmod *logmod,
+                             const struct logmod_logger *logger,
+                             const logmod_uint64 now,
+                             const int all,
+                             logmod_uint64 *next)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod_binary *binary = logger->options.binary;
+    FILE *file = binary ? binary->file : logger->options.logfile;
+    logmod_err code = LOGMOD_OK;
+    unsigned i;
+
+    logmod->lock(logger, 1);
+    if (file
+        && _logmod_flush_due(&logger->pending,
+                             logger->options.flush.interval_ms, now, all,
+                             next))
+    {
+        if (fflush(file) == EOF) code = LOGMOD_ERRNO;
+        memset(&mut_logger->pending, 0, sizeof mut_logger->pending);
+    }
+    for (i = 0; i < logger->num_sinks; ++i) {
+        struct logmod_sink *sink = logger->sinks[i];
+        if (sink->vtable->flush
+            && _logmod_flush_due(&sink->pending, sink->flush.interval_ms, now,
+                                 all, next))
+        {
+            const logmod_err flushed = sink->vtable->flush(sink);
+            if (code == LOGMOD_OK) code = flushed;
+            memset(&sink->pending, 0, sizeof sink->pending);
+        }
+    }
+    logmod->lock(logger, 0);
+    return code;
+}
+
+/**
+ * @brief Flush the logfiles, binary streams and sinks with records pending
+ * for longer than their flush interval, or with any record pending if `all`
+ * is 1
+ *
+ * Sets `next` to the nanoseconds until the next pending record is due, or 0
+ * if none.
+ * @return LOGMOD_OK, or the error of the first output that failed to flush
+ */
+static logmod_err
+_logmod_flush_pending(struct logmod *logmod,
+                      const int all,
+                      logmod_uint64 *next)
+{
+    const logmod_uint64 now = _logmod_clock_now(logmod);
+    logmod_err code = LOGMOD_OK;
+    size_t i;
+
+    *next = 0;
+    for (i = 0; i < logmod->length; ++i) {
+        const logmod_err flushed = _logmod_logger_flush_pending(
+            logmod, &logmod->loggers[i], now, all, next);
+        if (code == LOGMOD_OK) code = flushed;
+    }
+    return code;
+}
+
+/**
+ * Binary log format
+ *
+ * The stream starts with "LOGMOD", the format version, and the sizes of int,
+ * long, double, long double, void * and logmod_uint64, and 1 if
+ * little-endian or 0 if big-endian (1 byte each). Then follow entries, each
+ * starting with its type:
+ * - 'S' (call site): ID, level, line, flags (@ref _logmod_binary_flags()),
+ *   then label name, style, visibility and color, application ID, context
+ *   ID, filename and format string
+ * - 'Z' (time zone): UTC offset in minutes of the records that follow
+ * - 'R' (record): call site ID, timestamp delta, counter delta, then the
+ *   message arguments packed by _logmod_args_pack()
+ * - 'T' (text record): like 'R', with the formatted message instead
+ *
+ * Integers are unsigned LEB128 varints, deltas are zigzag-encoded, byte
+ * strings are their length followed by their bytes. Call site 0 is
+ * transient: it is described again before each of its records.
+ */
+#define LOGMOD_BINARY_VERSION 1
+
+static void
+_logmod_binary_varint(FILE *file, logmod_uint64 value)
+{
+    unsigned char bytes[10];
+    size_t length = 0;
+    do {
+        bytes[length] = (unsigned char)(value & 0x7f);
+        value >>= 7;
+        if (value) bytes[length] |= 0x80;
+        ++length;
+    } while (value);
+    fwrite(bytes, 1, length, file);
+}
+
+/** @brief Write a delta as a zigzag-encoded varint */
+static void
+_logmod_binary_delta(FILE *file, const logmod_uint64 delta)
+{
+    const int negative = delta > (logmod_uint64)-1 / 2;
+    _logmod_binary_varint(file,
+                          negative ? (~delta << 1) | 1 : delta << 1);
+}
+
+static void
+_logmod_binary_bytes(FILE *file, const char *data, const size_t length)
+{
+    _logmod_binary_varint(file, length);
+    fwrite(data, 1, length, file);
+}
+
+static void
+_logmod_binary_string(FILE *file, const char *str)
+{
+    _logmod_binary_bytes(file, str, strlen(str));
+}
+
+/** @brief Logger options the rendered prefix depends on */
+static unsigned
+_logmod_binary_flags(const struct logmod_options *options)
+{
+    return (options->hide_counter ? 1u : 0u)
+           | (options->suppress_time ? 2u : 0u)
+           | (options->show_application_id ? 4u : 0u)
+           | (options->hide_context_id ? 8u : 0u) | options->time_format << 4;
+}
+
+/**
+ * @brief Get the ID of the record's call site, describing it in the stream
+ * the first time
+ */
+static unsigned long
+_logmod_binary_site(struct logmod_binary *binary,
+                    const struct logmod_logger *logger,
+                    const struct _logmod_record *record)
+{
+    const struct logmod_info *info = &record->info;
+    const unsigned flags = _logmod_binary_flags(&logger->options);
+    const size_t hash = ((size_t)record->fmt >> 3) * 31
+                        + ((size_t)info->filename >> 3) * 7 + info->line * 3
+                        + info->level + ((size_t)logger >> 4);
+    unsigned long i, id = 0;
+
+    for (i = 0; i < binary->length; ++i) {
+        struct logmod_binary_site *site =
+            &binary->sites[(hash + i) % binary->length];
+        if (site->fmt == record->fmt && site->filename == info->filename
+            && site->line == info->line && site->level == info->level
+            && site->logger == logger && site->flags == flags)
+        {
+            return (unsigned long)(site - binary->sites) + 1;
+        }
+        if (site->fmt == NULL) {
+            site->fmt = record->fmt;
+            site->filename = info->filename;
+            site->logger = logger;
+            site->line = info->line;
+            site->level = info->level;
+            site->flags = flags;
+            id = (unsigned long)(site - binary->sites) + 1;
+            break;
+        }
+    }
+
+    putc('S', binary->file);
+    _logmod_binary_varint(binary->file, id);
+    _logmod_binary_varint(binary->file, info->level);
+    _logmod_binary_varint(binary->file, info->line);
+    _logmod_binary_varint(binary->file, flags);
+    _logmod_binary_string(binary->file, info->label->name);
+    _logmod_binary_string(binary->file, info->label->style);
+    _logmod_binary_string(binary->file, info->label->visibility);
+    _logmod_binary_string(binary->file, info->label->color);
+    _logmod_binary_string(binary->file,
+                          LOGMOD_FROM_LOGGER(logger)->application_id);
+    _logmod_binary_string(binary->file, logger->context_id);
+    _logmod_binary_string(binary->file, info->filename);
+    _logmod_binary_string(binary->file, record->fmt);
+    return id;
+}
+
+/** @brief Write a localized record to a binary log stream */
+static logmod_err
+_logmod_binary_write(struct logmod_binary *binary,
+                     const struct logmod_logger *logger,
+                     struct _logmod_record *record)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
+    const char *payload = record->packed;
+    size_t length = record->packed_length;
+    char data[LOGMOD_BUFFER_SIZE];
+    unsigned long site;
+    int failed;
+
+    if (!payload && record->args) {
+        struct _logmod_buffer packed;
+        packed.data = data;
+        packed.size = sizeof data;
+        packed.length = 0;
+        packed.overflow = 0;
+        if (_logmod_args_pack(&packed, record->fmt, *record->args)
+            == LOGMOD_OK)
+        {
+            payload = data;
+            length = packed.length;
+        }
+    }
+    if (!payload) { /* arguments can't be packed, keep the formatted text */
+        _logmod_record_format(record);
+        payload = record->message.body.data;
+        length = record->message.body.length;
+    }
+
+    logmod->lock(logger, 1);
+    site = _logmod_binary_site(binary, logger, record);
+    if (record->utc_offset != binary->utc_offset) {
+        putc('Z', binary->file);
+        _logmod_binary_delta(binary->file,
+                             (logmod_uint64)(long)record->utc_offset);
+        binary->utc_offset = record->utc_offset;
+    }
+    putc(payload == record->message.body.data ? 'T' : 'R', binary->file);
+    _logmod_binary_varint(binary->file, site);
+    _logmod_binary_delta(binary->file,
+                         record->info.timestamp - binary->timestamp);
+    _logmod_binary_delta(binary->file,
+                         (logmod_uint64)(record->info.counter
+                                         - binary->counter));
+    _logmod_binary_bytes(binary->file, payload, length);
+    binary->timestamp = record->info.timestamp;
+    binary->counter = record->info.counter;
+    failed = ferror(binary->file);
+    if (!_LOGMOD_FLUSH_BATCHED(&logger->options.flush)
+        || _logmod_flush_account(&logger->options.flush,
+                                 &mut_logger->pending, record, length))
+    {
+        failed = fflush(binary->file) == EOF || failed;
+        memset(&mut_logger->pending, 0, sizeof mut_logger->pending);
+    }
+    logmod->lock(logger, 0);
+    LOGMOD_EXPECT(!failed, LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_binary_init(struct logmod_binary *binary,
+                   FILE *file,
+                   struct logmod_binary_site sites[],
+                   unsigned long length)
+{
+    static const unsigned short endianness = 1;
+    unsigned char header[] = { 'L', 'O', 'G', 'M', 'O', 'D',
+                               LOGMOD_BINARY_VERSION,
+                               sizeof(int), sizeof(long), sizeof(double),
+                               sizeof(long double), sizeof(void *),
+                               sizeof(logmod_uint64), 0 };
+    LOGMOD_EXPECT(binary != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(file != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(sites != NULL || length == 0, LOGMOD_BAD_PARAMETER);
+    memset(binary, 0, sizeof *binary);
+    if (length) memset(sites, 0, length * sizeof *sites);
+    binary->file = file;
+    binary->sites = sites;
+    binary->length = length;
+    header[sizeof header - 1] = *(const unsigned char *)&endianness;
+    LOGMOD_EXPECT(fwrite(header, 1, sizeof header, file) == sizeof header,
+                  LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+
+/** @brief Write a localized record to the logger's console and logfile */
+static logmod_err
+_logmod_record_output(const struct logmod_logger *logger,
+                      struct _logmod_record *record)
+{
+    logmod_err code = LOGMOD_OK_CONTINUE;
+    if (!logger->options.quiet || record->info.level == LOGMOD_LEVEL_FATAL) {
+        FILE *output = record->info.label->output == 0 ? stdout : stderr;
+        _logmod_record_format(record);
+        code = _logmod_print(logger, record, logger->options.color, output);
+        if (code == LOGMOD_OK && fflush(output) == EOF) code = LOGMOD_ERRNO;
+    }
+    if (code >= LOGMOD_OK && logger->options.binary) {
+        code = _logmod_binary_write(logger->options.binary, logger, record);
+    }
+    else if (code >= LOGMOD_OK && logger->options.logfile) {
+        _logmod_record_format(record);
+        code = _logmod_print(logger, record, 0, logger->options.logfile);
+        if (code == LOGMOD_OK) code = _logmod_logfile_flush(logger, record);
+    }
+    return code;
+}
+
+/**
+ * @brief Write a localized record to the console and logfile if it passes
+ * the logger's level, and to the sinks that take its level
+ */
+static logmod_err
+_logmod_record_write(const struct logmod_logger *logger,
+                     struct _logmod_record *record)
+{
+    logmod_err code = LOGMOD_OK_CONTINUE;
+    if (record->info.level >= logger->options.level)
+        code = _logmod_record_output(logger, record);
+    if (code >= LOGMOD_OK && logger->num_sinks) {
+        const logmod_err sinks_code = _logmod_sinks_write(logger, record);
+        if (sinks_code != LOGMOD_OK_CONTINUE) code = sinks_code;
+    }
+    return code;
+}
+
+/**
+ * @brief Check if a built-in level is at or above `threshold` (`fallback`
+ * if 0), custom levels never are
+ */
+static int
+_logmod_level_reaches(const unsigned level,
+                      const unsigned threshold,
+                      const unsigned fallback)
+{
+    return level < LOGMOD_LEVEL_CUSTOM
+           && level >= (threshold ? threshold : fallback);
+}
+
+#ifdef LOGMOD_ASYNC
+#ifndef LOGMOD_ATOMICS
+#error "LOGMOD_ASYNC requires atomic operations (GCC, Clang or C11)"
+#endif
+#include <sched.h>
+
+/** @brief Header of a queued record, at the start of its first slot */
+struct _logmod_async_header {
+    const struct logmod_logger *logger;
+    const char *fmt; /**< Format string of the message */
+    const char *filename;
+    logmod_uint64 timestamp;
+    long counter;
+    unsigned line;
+    unsigned level;
+    int packed; /**< If 1, the body holds the packed arguments of `fmt`,
+                   otherwise the formatted message */
+    int sync; /**< If 1, the logging call waits for the record to be written
+                 and its outputs flushed */
+    unsigned long num_slots; /**< Number of slots taken by the record */
+    size_t length; /**< Length of the message body */
+};
+
+/**
+ * @brief Capture the message's arguments into its body, with as much room as
+ * the queue can take
+ */
+static logmod_err
+_logmod_message_pack(struct _logmod_message *message,
+                     const struct logmod_async_queue *queue,
+                     const char *fmt,
+                     va_list args)
+{
+    const size_t max_length = queue->capacity * LOGMOD_ASYNC_SLOT_SIZE
+                              - sizeof(struct _logmod_async_header);
+    message->body.data = message->data + LOGMOD_PREFIX_SIZE;
+    message->body.size = LOGMOD_BUFFER_SIZE;
+    if (message->body.size > max_length + 1)
+        message->body.size = max_length + 1;
+    message->body.length = 0;
+    message->body.overflow = 0;
+    return _logmod_args_pack(&message->body, fmt, args);
+}
+
+/**
+ * @brief Copy a message body into (or out of) the slots of the record at
+ * `position`, right after its header
+ */
+static void
+_logmod_async_copy_body(struct logmod_async_queue *queue,
+                        const unsigned long position,
+                        char *body,
+                        size_t length,
+                        const int into_slots)
+{
+    size_t offset = sizeof(struct _logmod_async_header);
+    unsigned long i;
+    for (i = 0; length > 0; ++i, offset = 0) {
+        char *data = queue->slots[(position + i) & (queue->capacity - 1)].data
+                     + offset;
+        size_t chunk = LOGMOD_ASYNC_SLOT_SIZE - offset;
+        if (chunk > length) chunk = length;
+        if (into_slots)
+            memcpy(data, body, chunk);
+        else
+            memcpy(body, data, chunk);
+        body += chunk;
+        length -= chunk;
+    }
+}
+
+/** @brief Check if the record at `position` has been published */
+static int
+_logmod_async_ready(const struct logmod_async_queue *queue,
+                    const unsigned long position)
+{
+    return queue->capacity
+           && LOGMOD_ATOMIC_LOAD(
+                  unsigned long,
+                  &queue->slots[position & (queue->capacity - 1)].sequence)
+                  == position + 1;
+}
+
+/** @brief Hand the slots of a taken record back to producers */
+static void
+_logmod_async_release(struct logmod_async_queue *queue,
+                      const unsigned long position,
+                      const unsigned long num_slots)
+{
+    unsigned long i;
+    for (i = 0; i < num_slots; ++i) {
+        LOGMOD_ATOMIC_STORE(
+            unsigned long,
+            &queue->slots[(position + i) & (queue->capacity - 1)].sequence,
+            position + i + queue->capacity);
+    }
+}
+
+/**
+ * @brief Block until the writer has consumed every position of `queue`
+ * before `end`
+ */
+static void
+_logmod_async_wait(struct logmod_async *async,
+                   struct logmod_async_queue *queue,
+                   const unsigned long end)
+{
+    LOGMOD_ATOMIC_FETCH_ADD(int, &async->waiting, 1);
+    LOGMOD_ATOMIC_FENCE();
+    pthread_mutex_lock(&async->mutex);
+    while ((long)(end - LOGMOD_ATOMIC_LOAD(unsigned long, &queue->written))
+           > 0)
+    {
+        pthread_cond_signal(&async->wake);
+        pthread_cond_wait(&async->progress, &async->mutex);
+    }
+    pthread_mutex_unlock(&async->mutex);
+    LOGMOD_ATOMIC_FETCH_ADD(int, &async->waiting, -1);
+}
+
+/** @brief Count a record dropped because the queue was full */
+static void
+_logmod_async_drop(struct logmod_async *async,
+                   const struct logmod_logger *logger,
+                   unsigned level)
+{
+    struct logmod_mut_logger *mut_logger = (struct logmod_mut_logger *)logger;
+    if (level > LOGMOD_LEVEL_CUSTOM) level = LOGMOD_LEVEL_CUSTOM;
+    LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &mut_logger->dropped[level], 1);
+    LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &mut_logger->unreported_drops, 1);
+    LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &async->drops, 1);
+}
+
+/**
+ * @brief Drop the oldest queued record, unless the writer takes it first
+ *
+ * The record is claimed like the writer does, by moving the tail past it.
+ */
+static void
+_logmod_async_drop_oldest(struct logmod_async *async,
+                          struct logmod_async_queue *queue)
+{
+    unsigned long position = LOGMOD_ATOMIC_LOAD(unsigned long, &queue->tail);
+    struct _logmod_async_header header;
+
+    if (!_logmod_async_ready(queue, position)) { /* still being filled in */
+        sched_yield();
+        return;
+    }
+    memcpy(&header, queue->slots[position & (queue->capacity - 1)].data,
+           sizeof header);
+    if (LOGMOD_ATOMIC_CAS(unsigned long, &queue->tail, &position,
+                          position + header.num_slots))
+    {
+        _logmod_async_drop(async, header.logger, header.level);
+        _logmod_async_release(queue, position, header.num_slots);
+    }
+}
+
+/**
+ * @brief Capture a record into the queue
+ *
+ * Claims as many consecutive slots as the record needs, fills them in, and
+ * publishes the first slot last so the writer never sees a partially
+ * written record. While the queue is full, applies the logging context's
+ * overflow policy, unless the record is `sync` (it then waits).
+ *
+ * @param end Set to the position past the record
+ * @return LOGMOD_OK, or LOGMOD_OK_SKIPPED if the record has been dropped
+ */
+static logmod_err
+_logmod_async_push(struct logmod_async *async,
+                   struct logmod_async_queue *queue,
+                   const struct logmod_logger *logger,
+                   const struct _logmod_record *record,
+                   const int sync,
+                   unsigned long *end)
+{
+    const unsigned long mask = queue->capacity - 1;
+    const size_t max_length = queue->capacity * LOGMOD_ASYNC_SLOT_SIZE
+                              - sizeof(struct _logmod_async_header);
+    const struct logmod *logmod = LOGMOD_FROM_LOGGER(logger);
+    struct _logmod_async_header header;
+    unsigned long position, i;
+
+    header.logger = logger;
+    header.fmt = record->fmt;
+    header.packed = record->packed != NULL;
+    header.sync = sync;
+    header.filename = record->info.filename;
+    header.timestamp = record->info.timestamp;
+    header.counter = record->info.counter;
+    header.line = record->info.line;
+    header.level = record->info.level;
+    header.length = record->packed ? record->packed_length
+                                   : record->message.body.length;
+    if (header.length > max_length) header.length = max_length;
+    header.num_slots = (unsigned long)((sizeof header + header.length
+                                        + LOGMOD_ASYNC_SLOT_SIZE - 1)
+                                       / LOGMOD_ASYNC_SLOT_SIZE);
+
+    position = LOGMOD_ATOMIC_LOAD(unsigned long, &queue->head);
+    for (;;) {
+        const unsigned long last = position + header.num_slots - 1;
+        long diff = 0;
+        /* every slot is checked, as records taken out of order (see
+           _logmod_async_drop_oldest()) release their slots out of order */
+        for (i = 0; i < header.num_slots && diff == 0; ++i) {
+            diff = (long)(LOGMOD_ATOMIC_LOAD(
+                              unsigned long,
+                              &queue->slots[(position + i) & mask].sequence)
+                          - (position + i));
+        }
+        if (diff == 0) {
+            if (LOGMOD_ATOMIC_CAS(unsigned long, &queue->head, &position,
+                                  position + header.num_slots))
+            {
+                break;
+            }
+        }
+        else {
+            if (diff < 0) { /* queue is full */
+                if (!sync
+                    && (logmod->overflow == LOGMOD_OVERFLOW_DROP_NEWEST
+                        || (logmod->overflow == LOGMOD_OVERFLOW_DROP_BELOW
+                            && header.level < logmod->overflow_level
+                            && header.level < LOGMOD_LEVEL_ERROR)))
+                {
+                    _logmod_async_drop(async, logger, header.level);
+                    return LOGMOD_OK_SKIPPED;
+                }
+                if (!sync && logmod->overflow == LOGMOD_OVERFLOW_DROP_OLDEST)
+                    _logmod_async_drop_oldest(async, queue);
+                else
+                    _logmod_async_wait(async, queue,
+                                       last + 1 - queue->capacity);
+            }
+            position = LOGMOD_ATOMIC_LOAD(unsigned long, &queue->head);
+        }
+    }
+
+    *end = position + header.num_slots;
+    memcpy(queue->slots[position & mask].data, &header, sizeof header);
+    _logmod_async_copy_body(
+        queue, position,
+        (char *)(record->packed ? record->packed : record->message.body.data),
+        header.length, 1);
+    for (i = header.num_slots; i-- > 0;) {
+        LOGMOD_ATOMIC_STORE(unsigned long,
+                            &queue->slots[(position + i) & mask].sequence,
+                            position + i + 1);
+    }
+
+    LOGMOD_ATOMIC_FENCE();
+    if (LOGMOD_ATOMIC_LOAD(int, &async->sleeping)) {
+        pthread_mutex_lock(&async->mutex);
+        pthread_cond_signal(&async->wake);
+        pthread_mutex_unlock(&async->mutex);
+    }
+    return LOGMOD_OK;
+}
+
+/**
+ * @brief Take the record at the head of the queue
+ *
+ * The record is claimed from its header alone, then copied out: a producer
+ * may drop it meanwhile (see _logmod_async_drop_oldest()), and reuse its
+ * slots, until it is claimed. A header read from reused slots fails the
+ * claim, as the tail has moved on.
+ *
+ * @param packed Scratch buffer of LOGMOD_BUFFER_SIZE bytes for deferred
+ * formatting
+ * @param sync Set to 1 if a logging call waits for the record
+ * @return Number of slots the record took, or 0 if the queue is empty
+ */
+static unsigned long
+_logmod_async_pop(struct logmod_async_queue *queue,
+                  struct _logmod_record *record,
+                  const struct logmod_logger **logger,
+                  char *packed,
+                  int *sync)
+{
+    unsigned long position = LOGMOD_ATOMIC_LOAD(unsigned long, &queue->tail);
+    struct _logmod_buffer *body = &record->message.body;
+    struct _logmod_async_header header;
+
+    do {
+        if (!_logmod_async_ready(queue, position)) return 0;
+        memcpy(&header, queue->slots[position & (queue->capacity - 1)].data,
+               sizeof header);
+    } while (!LOGMOD_ATOMIC_CAS(unsigned long, &queue->tail, &position,
+                                position + header.num_slots));
+
+    body->data = record->message.data + LOGMOD_PREFIX_SIZE;
+    body->size = LOGMOD_BUFFER_SIZE;
+    body->length = 0;
+    body->overflow = 0;
+    if (header.packed) { /* formatted on demand */
+        _logmod_async_copy_body(queue, position, packed, header.length, 0);
+        record->packed = packed;
+        record->packed_length = header.length;
+        record->formatted = 0;
+    }
+    else {
+        _logmod_async_copy_body(queue, position, body->data, header.length,
+                                0);
+        body->length = header.length;
+        body->data[body->length] = '\0';
+        record->packed = NULL;
+        record->formatted = 1;
+    }
+    _logmod_async_release(queue, position, header.num_slots);
+
+    *logger = header.logger;
+    *sync = header.sync;
+    _logmod_record_populate(
+        record, logmod_logger_get_label(header.logger, header.level),
+        header.line, header.filename, header.level, header.counter,
+        header.timestamp);
+    record->fmt = header.fmt;
+    record->args = NULL;
+    return header.num_slots;
+}
+
+/**
+ * @brief Queue records of `level` go to: the priority lane, the calling
+ * thread's staging buffer, or the shared queue
+ */
+static struct logmod_async_queue *
+_logmod_async_lane(struct logmod_async *async,
+                   const struct logmod *logmod,
+                   const unsigned level)
+{
+    struct logmod_async_staging *staging;
+    if (async->priority.capacity
+        && _logmod_level_reaches(level, logmod->priority_level,
+                                 LOGMOD_LEVEL_ERROR))
+    {
+        return &async->priority;
+    }
+    if ((staging = pthread_getspecific(async->key)) != NULL)
+        return &staging->queue;
+    return &async->queue;
+}
+
+/** @brief Sequence number of the next record of `queue`, if published */
+static int
+_logmod_async_peek(const struct logmod_async_queue *queue, long *counter)
+{
+    const unsigned long position =
+        LOGMOD_ATOMIC_LOAD(unsigned long, &queue->tail);
+    struct _logmod_async_header header;
+    if (!_logmod_async_ready(queue, position)) return 0;
+    memcpy(&header, queue->slots[position & (queue->capacity - 1)].data,
+           sizeof header);
+    *counter = header.counter;
+    return 1;
+}
+
+/**
+ * @brief Take the next record to be written, from the priority lane first
+ *
+ * Otherwise, the record with the lowest sequence number among the next
+ * ones of the shared queue and staging buffers is taken, so that records of
+ * different threads are written in the order they were logged.
+ *
+ * @return Queue the record was taken from, or NULL if all are empty
+ */
+static struct logmod_async_queue *
+_logmod_async_take(struct logmod_async *async,
+                   struct _logmod_record *record,
+                   const struct logmod_logger **logger,
+                   char *packed,
+                   int *sync)
+{
+    struct logmod_async_staging *staging;
+    struct logmod_async_queue *next;
+    long next_counter = 0, counter;
+
+    if (_logmod_async_pop(&async->priority, record, logger, packed, sync))
+        return &async->priority;
+    do {
+        next = _logmod_async_peek(&async->queue, &next_counter)
+                   ? &async->queue
+                   : NULL;
+        for (staging = LOGMOD_ATOMIC_LOAD(struct logmod_async_staging *,
+                                          &async->stagings);
+             staging; staging = staging->next)
+        {
+            if (_logmod_async_peek(&staging->queue, &counter)
+                && (!next || counter < next_counter))
+            {
+                next = &staging->queue;
+                next_counter = counter;
+            }
+        }
+        if (!next) return NULL;
+    } while (!_logmod_async_pop(next, record, logger, packed, sync));
+    return next;
+}
+
+/** @brief Check if any queue has a record to be written */
+static int
+_logmod_async_pending(const struct logmod_async *async)
+{
+    const struct logmod_async_staging *staging;
+    long counter;
+    if (_logmod_async_peek(&async->priority, &counter)
+        || _logmod_async_peek(&async->queue, &counter))
+    {
+        return 1;
+    }
+    for (staging = LOGMOD_ATOMIC_LOAD(struct logmod_async_staging *,
+                                      &async->stagings);
+         staging; staging = staging->next)
+    {
+        if (_logmod_async_peek(&staging->queue, &counter)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write a WARN record with the number of records each logger dropped
+ * since the last report
+ */
+static void
+_logmod_async_report_drops(struct logmod_async *async, struct logmod *logmod)
+{
+    const unsigned long drops =
+        LOGMOD_ATOMIC_LOAD(unsigned long, &async->drops);
+    size_t i;
+
+    LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &async->drops, 0 - drops);
+    for (i = 0; i < logmod->length; ++i) {
+        const struct logmod_logger *logger = &logmod->loggers[i];
+        struct logmod_mut_logger *mut_logger =
+            (struct logmod_mut_logger *)logger;
+        const unsigned long count =
+            LOGMOD_ATOMIC_LOAD(unsigned long, &logger->unreported_drops);
+        struct _logmod_record record;
+        struct _logmod_buffer *body = &record.message.body;
+
+        if (!count) continue;
+        LOGMOD_ATOMIC_FETCH_ADD(unsigned long, &mut_logger->unreported_drops,
+                                0 - count);
+        body->data = record.message.data + LOGMOD_PREFIX_SIZE;
+        body->size = LOGMOD_BUFFER_SIZE;
+        body->length = 0;
+        body->overflow = 0;
+        _logmod_buffer_long(body, (long)count, 0);
+        _logmod_buffer_puts(body, count == 1 ? " record dropped"
+                                             : " records dropped");
+        body->data[body->length] = '\0';
+        record.packed = NULL;
+        record.formatted = 1;
+        _logmod_record_populate(
+            &record, logmod_logger_get_label(logger, LOGMOD_LEVEL_WARN),
+            __LINE__, __FILE__, LOGMOD_LEVEL_WARN,
+            _logmod_counter_next(logmod, logger), _logmod_clock_now(logmod));
+        record.fmt = "%lu records dropped";
+        record.args = NULL;
+        _logmod_record_localize(&record, logger);
+        _logmod_record_write(logger, &record);
+    }
+}
+
+/**
+ * @brief Keep the first error of a flush run by the writer thread, for
+ * logmod_flush() or logmod_stop_async() to report
+ */
+static void
+_logmod_async_fail(struct logmod_async *async, const logmod_err code)
+{
+    int expected = LOGMOD_OK;
+    if (code != LOGMOD_OK)
+        LOGMOD_ATOMIC_CAS(int, &async->error, &expected, (int)code);
+}
+
+/** @brief Take the first error of the writer's flushes, or LOGMOD_OK */
+static logmod_err
+_logmod_async_error(struct logmod_async *async)
+{
+    int error = LOGMOD_ATOMIC_LOAD(int, &async->error);
+    while (error != LOGMOD_OK
+           && !LOGMOD_ATOMIC_CAS(int, &async->error, &error, LOGMOD_OK))
+        continue;
+    return (logmod_err)error;
+}
+
+/** @brief Writer thread: drain the queue, sleep while it is empty */
+static void *
+_logmod_async_writer(void *arg)
+{
+    struct logmod_async *async = arg;
+    struct logmod *logmod = async->logmod;
+    struct logmod_async_queue *queue;
+    struct _logmod_record record;
+    const struct logmod_logger *logger;
+    char packed[LOGMOD_BUFFER_SIZE];
+    logmod_uint64 due;
+    int sync;
+
+    for (;;) {
+        while ((queue = _logmod_async_take(async, &record, &logger, packed,
+                                           &sync)))
+        {
+            _logmod_record_localize(&record, logger);
+            _logmod_record_write(logger, &record);
+            if (sync) {
+                logmod_uint64 next = 0;
+                _logmod_async_fail(
+                    async, _logmod_logger_flush_pending(
+                               logmod, logger, record.info.timestamp, 1,
+                               &next));
+            }
+            /* reported before waiters are woken up, so flushes include it */
+            if (LOGMOD_ATOMIC_LOAD(unsigned long, &async->drops))
+                _logmod_async_report_drops(async, logmod);
+            /* records dropped past this one are done with as well */
+            LOGMOD_ATOMIC_STORE(unsigned long, &queue->written,
+                                LOGMOD_ATOMIC_LOAD(unsigned long,
+                                                   &queue->tail));
+            LOGMOD_ATOMIC_FENCE();
+            if (LOGMOD_ATOMIC_LOAD(int, &async->waiting)) {
+                pthread_mutex_lock(&async->mutex);
+                pthread_cond_broadcast(&async->progress);
+                pthread_mutex_unlock(&async->mutex);
+            }
+        }
+        /* while idle, act as the timer of the context's flush policies */
+        _logmod_async_fail(async, _logmod_flush_pending(logmod, 0, &due));
+        pthread_mutex_lock(&async->mutex);
+        LOGMOD_ATOMIC_STORE(int, &async->sleeping, 1);
+        LOGMOD_ATOMIC_FENCE();
+        if (!_logmod_async_pending(async)) {
+            if (async->stopping) {
+                pthread_mutex_unlock(&async->mutex);
+                _logmod_async_fail(async,
+                                   _logmod_flush_pending(logmod, 1, &due));
+                break;
+            }
+            if (due) {
+                const logmod_uint64 deadline = _logmod_clock_realtime() + due;
+                struct timespec ts;
+                ts.tv_sec = (time_t)(deadline / LOGMOD_NSEC_PER_SEC);
+                ts.tv_nsec = (long)(deadline % LOGMOD_NSEC_PER_SEC);
+                pthread_cond_timedwait(&async->wake, &async->mutex, &ts);
+            }
+            else {
+                pthread_cond_wait(&async->wake, &async->mutex);
+            }
+        }
+        LOGMOD_ATOMIC_STORE(int, &async->sleeping, 0);
+        pthread_mutex_unlock(&async->mutex);
+    }
+    return NULL;
+}
+
+/** @brief Set up an empty queue over `slots` */
+static void
+_logmod_async_queue_init(struct logmod_async_queue *queue,
+                         struct logmod_async_slot slots[],
+                         unsigned long capacity)
+{
+    unsigned long i;
+    for (i = 0; i < capacity; ++i)
+        slots[i].sequence = i;
+    queue->slots = slots;
+    queue->capacity = capacity;
+}
+
+LOGMOD_API logmod_err
+logmod_start_async(struct logmod *logmod,
+                   struct logmod_async *async,
+                   struct logmod_async_slot slots[],
+                   unsigned long capacity)
+{
+    return logmod_start_async_priority(logmod, async, slots, capacity, NULL,
+                                       0);
+}
+
+LOGMOD_API logmod_err
+logmod_start_async_priority(struct logmod *logmod,
+                            struct logmod_async *async,
+                            struct logmod_async_slot slots[],
+                            unsigned long capacity,
+                            struct logmod_async_slot priority_slots[],
+                            unsigned long priority_capacity)
+{
+    struct logmod_async **mut_async = (struct logmod_async **)&logmod->async;
+    int error;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(logmod->async == NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(async != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(slots != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(capacity > 0 && (capacity & (capacity - 1)) == 0,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(priority_slots != NULL || priority_capacity == 0,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT((priority_capacity & (priority_capacity - 1)) == 0,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(sizeof(struct _logmod_async_header) < LOGMOD_ASYNC_SLOT_SIZE,
+                  LOGMOD_BAD_PARAMETER);
+    memset(async, 0, sizeof *async);
+    async->logmod = logmod;
+    _logmod_async_queue_init(&async->queue, slots, capacity);
+    _logmod_async_queue_init(&async->priority, priority_slots,
+                             priority_capacity);
+    LOGMOD_EXPECT(pthread_key_create(&async->key, NULL) == 0, LOGMOD_ERRNO);
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->wake, NULL);
+    pthread_cond_init(&async->progress, NULL);
+    error = pthread_create(&async->thread, NULL, _logmod_async_writer, async);
+    if (error) {
+        pthread_cond_destroy(&async->progress);
+        pthread_cond_destroy(&async->wake);
+        pthread_mutex_destroy(&async->mutex);
+        pthread_key_delete(async->key);
+    }
+    LOGMOD_EXPECT(error == 0, LOGMOD_ERRNO);
+    *mut_async = async;
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_stop_async(struct logmod *logmod)
+{
+    struct logmod_async **mut_async = (struct logmod_async **)&logmod->async;
+    struct logmod_async *async;
+    logmod_err code;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(logmod->async != NULL, LOGMOD_BAD_PARAMETER);
+    async = logmod->async;
+    pthread_mutex_lock(&async->mutex);
+    async->stopping = 1;
+    pthread_cond_signal(&async->wake);
+    pthread_mutex_unlock(&async->mutex);
+    LOGMOD_EXPECT(pthread_join(async->thread, NULL) == 0, LOGMOD_ERRNO);
+    pthread_cond_destroy(&async->progress);
+    pthread_cond_destroy(&async->wake);
+    pthread_mutex_destroy(&async->mutex);
+    pthread_key_delete(async->key);
+    *mut_async = NULL;
+    code = _logmod_async_error(async);
+    LOGMOD_EXPECT(code == LOGMOD_OK, code);
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+logmod_async_register(struct logmod *logmod,
+                      struct logmod_async_staging *staging,
+                      struct logmod_async_slot slots[],
+                      unsigned long capacity)
+{
+    struct logmod_async *async;
+    LOGMOD_EXPECT(logmod != NULL && logmod->async != NULL,
+                  LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(staging != NULL && slots != NULL, LOGMOD_BAD_PARAMETER);
+    LOGMOD_EXPECT(capacity > 0 && (capacity & (capacity - 1)) == 0,
+                  LOGMOD_BAD_PARAMETER);
+    async = logmod->async;
+    memset(staging, 0, sizeof *staging);
+    _logmod_async_queue_init(&staging->queue, slots, capacity);
+    staging->next =
+        LOGMOD_ATOMIC_LOAD(struct logmod_async_staging *, &async->stagings);
+    while (!LOGMOD_ATOMIC_CAS(struct logmod_async_staging *, &async->stagings,
+                              &staging->next, staging))
+        continue;
+    LOGMOD_EXPECT(pthread_setspecific(async->key, staging) == 0,
+                  LOGMOD_ERRNO);
+    return LOGMOD_OK;
+}
+#endif /* LOGMOD_ASYNC */
+
+LOGMOD_API logmod_err
+logmod_flush(struct logmod *logmod)
+{
+    logmod_uint64 next;
+    logmod_err code = LOGMOD_OK, flushed;
+    size_t i;
+    LOGMOD_EXPECT(logmod != NULL, LOGMOD_BAD_PARAMETER);
+#ifdef LOGMOD_ASYNC
+    if (logmod->async) {
+        struct logmod_async *async = logmod->async;
+        struct logmod_async_staging *staging;
+        _logmod_async_wait(async, &async->priority,
+                           LOGMOD_ATOMIC_LOAD(unsigned long,
+                                              &async->priority.head));
+        _logmod_async_wait(async, &async->queue,
+                           LOGMOD_ATOMIC_LOAD(unsigned long,
+                                              &async->queue.head));
+        for (staging = LOGMOD_ATOMIC_LOAD(struct logmod_async_staging *,
+                                          &async->stagings);
+             staging; staging = staging->next)
+        {
+            _logmod_async_wait(async, &staging->queue,
+                               LOGMOD_ATOMIC_LOAD(unsigned long,
+                                                  &staging->queue.head));
+        }
+        code = _logmod_async_error(async);
+    }
+#endif
+    flushed = _logmod_flush_pending(logmod, 1, &next);
+    if (code == LOGMOD_OK) code = flushed;
+    LOGMOD_EXPECT(code == LOGMOD_OK, code);
+    LOGMOD_EXPECT(fflush(stdout) != EOF, LOGMOD_ERRNO);
+    LOGMOD_EXPECT(fflush(stderr) != EOF, LOGMOD_ERRNO);
+    for (i = 0; i < logmod->length; ++i) {
+        FILE *logfile = logmod->loggers[i].options.logfile;
+        struct logmod_binary *binary = logmod->loggers[i].options.binary;
+        if (logfile) LOGMOD_EXPECT(fflush(logfile) != EOF, LOGMOD_ERRNO);
+        if (binary) LOGMOD_EXPECT(fflush(binary->file) != EOF, LOGMOD_ERRNO);
+    }
+    return LOGMOD_OK;
+}
+
+LOGMOD_API logmod_err
+_logmod_log(const struct logmod_logger *logger,
+            const unsigned line,
+            const char *const filename,
+            const unsigned level,
+            const char *fmt,
+            ...)
+{
+    struct _logmod_record record;
+    struct logmod *logmod;
+#ifdef LOGMOD_ASYNC
+    struct logmod_async_queue *queue = NULL;
+    unsigned long end;
+#endif
+    logmod_err code;
+    va_list args, args_copy;
+    int sync, direct = 1; /* written by the logging thread */
+
+    if (!logger) logger = &g_loggers[0];
+    if (level < logger->threshold) return LOGMOD_OK_SKIPPED;
+
+    logmod = LOGMOD_FROM_LOGGER(logger);
+    /* written and flushed before returning, even in asynchronous mode */
+    sync = _logmod_level_reaches(level, logmod->sync_level,
+                                 LOGMOD_LEVEL_FATAL);
+#ifdef LOGMOD_ASYNC
+    /* only the writer thread writes while it runs, so it writes its own
+       records directly rather than waiting for itself */
+    if (logmod->async
+        && !(sync && pthread_equal(pthread_self(), logmod->async->thread)))
+    {
+        queue = _logmod_async_lane(logmod->async, logmod, level);
+        direct = 0;
+    }
+#endif
+    va_start(args, fmt);
+    record.packed = NULL;
+#ifdef LOGMOD_ASYNC
+    if (queue && logger->options.defer_formatting && !logger->callback
+        && _logmod_message_pack(&record.message, queue, fmt, args)
+               == LOGMOD_OK)
+    {
+        record.packed = record.message.body.data;
+        record.packed_length = record.message.body.length;
+    }
+#endif
+    record.formatted = !record.packed;
+    code = LOGMOD_OK;
+    if (record.formatted) {
+        LOGMOD_VA_COPY(args_copy, args);
+        code = _logmod_message_format(&record.message, fmt, args_copy);
+        va_end(args_copy);
+    }
+    if (code == LOGMOD_OK) {
+        _logmod_record_populate(&record, logmod_logger_get_label(logger, level),
+                                line, filename, level,
+                                _logmod_counter_next(logmod, logger),
+                                _logmod_clock_now(logmod));
+        record.fmt = fmt;
+        record.args = &args;
+        /* in asynchronous mode, leave time conversion to the writer */
+        if (logger->callback || direct)
+            _logmod_record_localize(&record, logger);
+        code = LOGMOD_OK_CONTINUE;
+        if (logger->callback
+            && (level >= logger->options.level
+                || logger->options.callback_all_levels))
+        {
+            LOGMOD_VA_COPY(args_copy, args);
+            code = logger->callback(logger, &record.info, fmt, args_copy);
+            va_end(args_copy);
+        }
+        if (code == LOGMOD_OK_CONTINUE
+            && (level >= logger->options.level
+                || _LOGMOD_SINK_MASK(logger, level)))
+        {
+#ifdef LOGMOD_ASYNC
+            if (queue) {
+                code = _logmod_async_push(logmod->async, queue, logger,
+                                          &record, sync, &end);
+                /* the writer flushes the outputs once it is written */
+                if (sync && code == LOGMOD_OK)
+                    _logmod_async_wait(logmod->async, queue, end);
+            }
+            else
+#endif
+                code = _logmod_record_write(logger, &record);
+        }
+        if (sync && direct && code >= LOGMOD_OK) {
+            logmod_uint64 next = 0;
+            const logmod_err flushed = _logmod_logger_flush_pending(
+                logmod, logger, record.info.timestamp, 1, &next);
+            if (flushed != LOGMOD_OK) code = flushed;
         }
-    _end:
-        logmod->lock(logger, 1);
-        ++logmod->counter;
-        logmod->lock(logger, 0);
-        va_end(args);
     }
+    va_end(args);
     return code;
 }
 
@@ -0,0 +1,573 @@
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE /* syscall() */
+#define LOGMOD_ASYNC
+#define LOGMOD_MMAP_SINK
+#define LOGMOD_URING_SINK
+#include "../logmod.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TABLE_LENGTH 5
+
+#ifdef LOGMOD_NO_CACHE_LINE_PADDING
+#define BENCH_LAYOUT ", unpadded"
+#else
+#define BENCH_LAYOUT ""
+#endif
+
+/* logger is re-read every iteration, as it would be in real code */
+static struct logmod_logger *volatile bench_logger;
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void
+report(const char *name, double elapsed_ns, long iterations)
+{
+    printf("%-40s %10.2f ns/call\n", name, elapsed_ns / (double)iterations);
+}
+
+static void
+start_thread(pthread_t *thread, void *(*start)(void *), void *arg)
+{
+    if (pthread_create(thread, NULL, start, arg) != 0) {
+        fprintf(stderr, "pthread_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+bench_filtered_level(long iterations)
+{
+    double start;
+    long i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_INFO);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(TRACE, bench_logger, ("filtered %ld", i), 1);
+    }
+    report("filtered by level (TRACE < INFO)", now_ns() - start, iterations);
+}
+
+static void
+bench_disabled_logger(struct logmod *logmod, long iterations)
+{
+    double start;
+    long i;
+
+    logmod_toggle_logger(logmod, "BENCH");
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(ERROR, bench_logger, ("disabled %ld", i), 1);
+    }
+    report("disabled logger", now_ns() - start, iterations);
+    logmod_toggle_logger(logmod, "BENCH");
+}
+
+static void
+bench_emitted(long iterations)
+{
+    FILE *fp = fopen("/dev/null", "w");
+    double start;
+    long i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger, ("emitted %ld", i), 1);
+    }
+    report("emitted to /dev/null", now_ns() - start, iterations);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("emitted to /dev/null, 5 conversions", now_ns() - start,
+           iterations);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(fp);
+}
+
+static void
+bench_flush_policy(long iterations)
+{
+    struct logmod_flush_policy policy = { 0, 64 * 1024, 1000, 0 };
+    FILE *fp = tmpfile();
+    double start;
+    long i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger, ("emitted %ld", i), 1);
+    }
+    report("emitted to file, flushed every record", now_ns() - start,
+           iterations);
+    logmod_logger_set_flush_policy(bench_logger, policy);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger, ("emitted %ld", i), 1);
+    }
+    report("emitted to file, flushed every 64 KiB", now_ns() - start,
+           iterations);
+    memset(&policy, 0, sizeof policy);
+    logmod_logger_set_flush_policy(bench_logger, policy);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(fp);
+}
+
+static FILE *tee_file;
+
+/* how extra files used to be fed, for reference */
+static logmod_err
+tee_callback(const struct logmod_logger *logger,
+             const struct logmod_info *info,
+             const char *fmt,
+             va_list args)
+{
+    (void)logger;
+    fprintf(tee_file, "%ld %s %s:%u: ", info->counter, info->label->name,
+            info->filename, info->line);
+    vfprintf(tee_file, fmt, args);
+    fputc('\n', tee_file);
+    fflush(tee_file);
+    return LOGMOD_OK_CONTINUE;
+}
+
+static void
+bench_sinks(long iterations)
+{
+    FILE *fp = fopen("/dev/null", "w");
+    struct logmod_sink sink;
+    struct logmod_mmap map;
+    static char buffers[8][64 * 1024];
+    struct logmod_uring uring;
+    double start;
+    long i;
+
+    tee_file = fopen("/dev/null", "w");
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    logmod_logger_set_callback(bench_logger, NULL, 0, tee_callback);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + tee callback", now_ns() - start, iterations);
+    logmod_logger_set_callback(bench_logger, NULL, 0, NULL);
+
+    logmod_sink_init_file(&sink, tee_file, LOGMOD_LEVEL_TRACE,
+                          LOGMOD_SINK_PLAIN);
+    logmod_logger_add_sink(bench_logger, &sink);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + file sink", now_ns() - start, iterations);
+    logmod_logger_remove_sink(bench_logger, &sink);
+
+    logmod_sink_init_fd(&sink, fileno(tee_file), LOGMOD_LEVEL_TRACE,
+                        LOGMOD_SINK_PLAIN);
+    logmod_logger_add_sink(bench_logger, &sink);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + fd sink", now_ns() - start, iterations);
+    logmod_logger_remove_sink(bench_logger, &sink);
+
+    /* a mapping of /dev/null can't be written to, use a real file */
+    fclose(tee_file);
+    tee_file = tmpfile();
+    logmod_sink_init_fd(&sink, fileno(tee_file), LOGMOD_LEVEL_TRACE,
+                        LOGMOD_SINK_PLAIN);
+    logmod_logger_add_sink(bench_logger, &sink);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + fd sink, regular file", now_ns() - start, iterations);
+    logmod_logger_remove_sink(bench_logger, &sink);
+
+    logmod_sink_init_mmap(&sink, &map, fileno(tee_file), 1 << 20,
+                          LOGMOD_LEVEL_TRACE, LOGMOD_SINK_PLAIN);
+    logmod_logger_add_sink(bench_logger, &sink);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + mmap sink, regular file", now_ns() - start,
+           iterations);
+    logmod_logger_remove_sink(bench_logger, &sink);
+
+    logmod_sink_init_uring(&sink, &uring, fileno(tee_file), buffers[0],
+                           sizeof buffers[0], 8, LOGMOD_LEVEL_TRACE,
+                           LOGMOD_SINK_PLAIN);
+    sink.flush.bytes = sizeof buffers[0];
+    logmod_logger_add_sink(bench_logger, &sink);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %.2f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report("logfile + io_uring sink, regular file", now_ns() - start,
+           iterations);
+    logmod_logger_remove_sink(bench_logger, &sink);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(tee_file);
+    fclose(fp);
+}
+
+static void
+bench_async(struct logmod *logmod, long iterations, int defer_formatting)
+{
+    static struct logmod_async_slot slots[1 << 16];
+    struct logmod_async async;
+    FILE *fp = fopen("/dev/null", "w");
+    double start;
+    long i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    logmod_logger_set_defer_formatting(bench_logger, defer_formatting);
+    logmod_start_async(logmod, &async, slots, sizeof(slots) / sizeof *slots);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger,
+                    ("wide %ld %f %f %s %lu", i, (double)i / 3, 1.0 / 7,
+                     "request-id", (unsigned long)i * 7),
+                    5);
+    }
+    report(defer_formatting ? "async, deferred formatting (caller)"
+                            : "async, eager formatting (caller)",
+           now_ns() - start, iterations);
+    logmod_stop_async(logmod);
+    logmod_logger_set_defer_formatting(bench_logger, 0);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(fp);
+}
+
+/* logger lookup as it used to be done, for reference */
+static struct logmod_logger *
+linear_lookup(struct logmod *logmod, const char *context_id)
+{
+    size_t i;
+    for (i = 0; i < logmod->length; ++i) {
+        if (0 == strcmp(logmod->loggers[i].context_id, context_id))
+            return (struct logmod_logger *)&logmod->loggers[i];
+    }
+    return NULL;
+}
+
+static void
+bench_async_overflow(struct logmod *logmod,
+                     long iterations,
+                     enum logmod_overflow_policies policy,
+                     const char *name)
+{
+    static struct logmod_async_slot slots[256];
+    struct logmod_async async;
+    FILE *fp = fopen("/dev/null", "w");
+    unsigned long dropped;
+    double start;
+    long i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    logmod_set_overflow_policy(logmod, policy, LOGMOD_LEVEL_WARN);
+    dropped = logmod_logger_get_dropped(bench_logger, LOGMOD_LEVEL_INFO);
+    logmod_start_async(logmod, &async, slots, sizeof(slots) / sizeof *slots);
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(INFO, bench_logger, ("burst %ld", i), 1);
+    }
+    report(name, now_ns() - start, iterations);
+    logmod_stop_async(logmod);
+    dropped = logmod_logger_get_dropped(bench_logger, LOGMOD_LEVEL_INFO)
+              - dropped;
+    printf("%-40s %10.2f %%\n", "  dropped",
+           100.0 * (double)dropped / (double)iterations);
+    logmod_set_overflow_policy(logmod, LOGMOD_OVERFLOW_BLOCK, 0);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(fp);
+}
+
+#define BENCH_PRODUCERS 8
+
+/* producing thread, registering a staging buffer if given one */
+struct bench_producer {
+    struct logmod *logmod;
+    struct logmod_async_staging *staging;
+    struct logmod_async_slot *slots;
+    unsigned long capacity;
+    long iterations;
+};
+
+static void *
+bench_producer(void *arg)
+{
+    const struct bench_producer *producer = arg;
+    long i;
+    if (producer->staging) {
+        logmod_async_register(producer->logmod, producer->staging,
+                              producer->slots, producer->capacity);
+    }
+    for (i = 0; i < producer->iterations; ++i) {
+        logmod_nlog(INFO, bench_logger, ("burst %ld", i), 1);
+    }
+    return NULL;
+}
+
+static void
+bench_async_producers(struct logmod *logmod, long iterations, int staged)
+{
+    static struct logmod_async_slot slots[256];
+    static struct logmod_async_staging staging[BENCH_PRODUCERS];
+    static struct logmod_async_slot staging_slots[BENCH_PRODUCERS][256];
+    struct bench_producer producers[BENCH_PRODUCERS];
+    pthread_t threads[BENCH_PRODUCERS];
+    struct logmod_async async;
+    FILE *fp = fopen("/dev/null", "w");
+    char name[64];
+    double start;
+    int i;
+
+    logmod_logger_set_level(bench_logger, LOGMOD_LEVEL_TRACE);
+    logmod_logger_set_quiet(bench_logger, 1);
+    logmod_logger_set_logfile(bench_logger, fp);
+    logmod_start_async(logmod, &async, slots, sizeof(slots) / sizeof *slots);
+    start = now_ns();
+    for (i = 0; i < BENCH_PRODUCERS; ++i) {
+        producers[i].logmod = logmod;
+        producers[i].staging = staged ? &staging[i] : NULL;
+        producers[i].slots = staging_slots[i];
+        producers[i].capacity = 256;
+        producers[i].iterations = iterations / BENCH_PRODUCERS;
+        start_thread(&threads[i], bench_producer, &producers[i]);
+    }
+    for (i = 0; i < BENCH_PRODUCERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    logmod_flush(logmod);
+    sprintf(name, "async, %d producers%s", BENCH_PRODUCERS,
+            staged ? ", staged" : "");
+    report(name, now_ns() - start, iterations);
+    logmod_stop_async(logmod);
+    logmod_logger_set_logfile(bench_logger, NULL);
+    fclose(fp);
+}
+
+#define BENCH_MAX_THREADS 64
+
+/* thread logging to a logger of its own, among loggers of other threads */
+struct bench_thread {
+    struct logmod *logmod;
+    const char *context_id;
+    long iterations;
+};
+
+static void *
+bench_thread(void *arg)
+{
+    const struct bench_thread *thread = arg;
+    long i;
+    for (i = 0; i < thread->iterations; ++i) {
+        struct logmod_logger *logger =
+            logmod_get_logger(thread->logmod, thread->context_id);
+        logmod_nlog(DEBUG, logger, ("filtered %ld", i), 1);
+        logmod_nlog(DEBUG, logger, ("filtered %ld", i), 1);
+        logmod_nlog(INFO, logger, ("emitted %ld", i), 1);
+    }
+    return NULL;
+}
+
+static void
+bench_contended(long iterations, int num_threads)
+{
+    static struct logmod_logger table[BENCH_MAX_THREADS];
+    static char context_ids[BENCH_MAX_THREADS][16];
+    const struct logmod_flush_policy policy = { 0, 64 * 1024, 0, 0 };
+    struct bench_thread threads[BENCH_MAX_THREADS];
+    pthread_t ids[BENCH_MAX_THREADS];
+    FILE *files[BENCH_MAX_THREADS];
+    struct logmod logmod;
+    char name[64];
+    double start;
+    int i;
+
+    logmod_init(&logmod, "BENCH_APP", table, BENCH_MAX_THREADS);
+    for (i = 0; i < num_threads; ++i) {
+        struct logmod_logger *logger;
+        sprintf(context_ids[i], "THREAD_%d", i);
+        logger = logmod_get_logger(&logmod, context_ids[i]);
+        files[i] = fopen("/dev/null", "w");
+        logmod_logger_set_level(logger, LOGMOD_LEVEL_INFO);
+        logmod_logger_set_quiet(logger, 1);
+        logmod_logger_set_logfile(logger, files[i]);
+        logmod_logger_set_flush_policy(logger, policy);
+        threads[i].logmod = &logmod;
+        threads[i].context_id = context_ids[i];
+        threads[i].iterations = iterations / num_threads;
+    }
+    start = now_ns();
+    for (i = 0; i < num_threads; ++i) {
+        start_thread(&ids[i], bench_thread, &threads[i]);
+    }
+    for (i = 0; i < num_threads; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+    sprintf(name, "lookup + 3 calls, %d threads" BENCH_LAYOUT, num_threads);
+    report(name, now_ns() - start, iterations);
+    logmod_cleanup(&logmod);
+    for (i = 0; i < num_threads; ++i) {
+        fclose(files[i]);
+    }
+}
+
+static void
+bench_lookup(long iterations, int num_contexts)
+{
+    static struct logmod_logger table[1000];
+    static char context_ids[1000][16];
+    struct logmod logmod;
+    volatile unsigned long sink = 0;
+    char name[64];
+    double start;
+    long i;
+    int j;
+
+    logmod_init(&logmod, "BENCH_APP", table, (unsigned)num_contexts);
+    for (j = 0; j < num_contexts; ++j) {
+        sprintf(context_ids[j], "CONTEXT_%d", j);
+        logmod_get_logger(&logmod, context_ids[j]);
+    }
+
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        sink += (unsigned long)logmod_get_logger(
+            &logmod, context_ids[i % num_contexts]);
+    }
+    sprintf(name, "logger lookup, %d contexts", num_contexts);
+    report(name, now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        sink += (unsigned long)linear_lookup(&logmod,
+                                             context_ids[i % num_contexts]);
+    }
+    sprintf(name, "linear lookup, %d contexts", num_contexts);
+    report(name, now_ns() - start, iterations);
+
+    (void)sink;
+    logmod_cleanup(&logmod);
+}
+
+static void
+bench_cached_logger(long iterations)
+{
+    static struct logmod_logger table[128];
+    static char context_ids[100][16];
+    struct logmod logmod;
+    double start;
+    long i;
+    int j;
+
+    logmod_init(&logmod, "BENCH_APP", table, 128);
+    for (j = 0; j < 100; ++j) {
+        sprintf(context_ids[j], "CONTEXT_%d", j);
+        logmod_logger_set_level(logmod_get_logger(&logmod, context_ids[j]),
+                                LOGMOD_LEVEL_INFO);
+    }
+
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog(TRACE, logmod_get_logger(&logmod, "CONTEXT_99"),
+                    ("filtered %ld", i), 1);
+    }
+    report("lookup per call, filtered", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+        logmod_nlog_context(TRACE, &logmod, "CONTEXT_99", ("filtered %ld", i),
+                            1);
+    }
+    report("cached per call site, filtered", now_ns() - start, iterations);
+
+    logmod_cleanup(&logmod);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct logmod_logger table[TABLE_LENGTH];
+    struct logmod logmod;
+    long iterations = argc > 1 ? atol(argv[1]) : 10000000L;
+
+    logmod_init(&logmod, "BENCH_APP", table, TABLE_LENGTH);
+    bench_logger = logmod_get_logger(&logmod, "BENCH");
+
+    bench_filtered_level(iterations);
+    bench_disabled_logger(&logmod, iterations);
+    bench_emitted(iterations / 100);
+    bench_flush_policy(iterations / 100);
+    bench_sinks(iterations / 100);
+    bench_async(&logmod, iterations / 100, 0);
+    bench_async(&logmod, iterations / 100, 1);
+    bench_async_overflow(&logmod, iterations / 100, LOGMOD_OVERFLOW_BLOCK,
+                         "async overflow, block (caller)");
+    bench_async_overflow(&logmod, iterations / 100,
+                         LOGMOD_OVERFLOW_DROP_NEWEST,
+                         "async overflow, drop newest (caller)");
+    bench_async_overflow(&logmod, iterations / 100,
+                         LOGMOD_OVERFLOW_DROP_OLDEST,
+                         "async overflow, drop oldest (caller)");
+    bench_async_producers(&logmod, iterations / 100, 0);
+    bench_async_producers(&logmod, iterations / 100, 1);
+    bench_contended(iterations / 10, 1);
+    bench_contended(iterations / 10, 2);
+    bench_contended(iterations / 10, 4);
+    bench_contended(iterations / 10, 8);
+    bench_contended(iterations / 10, 32);
+    bench_contended(iterations / 10, 64);
+    bench_lookup(iterations / 10, 10);
+    bench_lookup(iterations / 10, 100);
+    bench_lookup(iterations / 10, 1000);
+    bench_cached_logger(iterations / 10);
+
+    logmod_cleanup(&logmod);
+    return EXIT_SUCCESS;
+}
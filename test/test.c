@@ -1,4 +1,11 @@
-#define _POSIX_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE /* syscall() */
+#define LOGMOD_COMPILE_MIN_LEVEL LOGMOD_LEVEL_DEBUG
+#define LOGMOD_ASYNC
+#define LOGMOD_MMAP_SINK
+#define LOGMOD_ROTATING_SINK
+#define LOGMOD_URING_SINK
+#define LOGMOD_DURABLE_SINK
 #include "../logmod.h"
 #include "greatest.h"
 #include <stdio.h>
@@ -6,6 +13,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #define TABLE_LENGTH 5
 
@@ -37,6 +47,39 @@ test_callback(const struct logmod_logger *logger,
     return LOGMOD_OK;
 }
 
+static logmod_err
+continue_callback(const struct logmod_logger *logger,
+                  const struct logmod_info *info,
+                  const char *fmt,
+                  va_list args)
+{
+    (void)logger;
+    (void)fmt;
+    (void)args;
+    callback_was_called = 1;
+    last_label = info->label->name;
+    return LOGMOD_OK_CONTINUE;
+}
+
+static char last_formatted[256];
+static logmod_uint64 last_timestamp;
+static long last_counter;
+
+static logmod_err
+message_callback(const struct logmod_logger *logger,
+                 const struct logmod_info *info,
+                 const char *fmt,
+                 va_list args)
+{
+    (void)logger;
+    (void)fmt;
+    (void)args;
+    strncpy(last_formatted, info->message, sizeof(last_formatted) - 1);
+    last_timestamp = info->timestamp;
+    last_counter = info->counter;
+    return LOGMOD_OK_CONTINUE;
+}
+
 TEST
 should_initialize_application(void)
 {
@@ -71,6 +114,126 @@ should_initialize_context(void)
     PASS();
 }
 
+#define LOOKUP_CONTEXTS 64
+#define LOOKUP_THREADS  4
+
+static char lookup_ids[LOOKUP_CONTEXTS][16];
+static pthread_mutex_t lookup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+lookup_lock(const struct logmod_logger *logger, int should_lock)
+{
+    (void)logger;
+    if (should_lock)
+        pthread_mutex_lock(&lookup_mutex);
+    else
+        pthread_mutex_unlock(&lookup_mutex);
+}
+
+static void *
+lookup_worker(void *arg)
+{
+    struct logmod *logmod = arg;
+    int i, misses = 0;
+    for (i = 0; i < LOOKUP_CONTEXTS; ++i) {
+        struct logmod_logger *logger =
+            logmod_get_logger(logmod, lookup_ids[i]);
+        if (!logger || strcmp(logger->context_id, lookup_ids[i]) != 0)
+            ++misses;
+    }
+    return misses ? arg : NULL;
+}
+
+TEST
+should_look_up_loggers_by_context(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    struct logmod_logger table[LOOKUP_CONTEXTS], *loggers[LOOKUP_CONTEXTS];
+    struct logmod logmod;
+    pthread_t threads[LOOKUP_THREADS];
+    void *result;
+    int i;
+
+    for (i = 0; i < LOOKUP_CONTEXTS; ++i) {
+        sprintf(lookup_ids[i], "MODULE_%d", i);
+    }
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logmod_set_lock(&logmod, lookup_lock);
+
+    /* concurrent creation of the same contexts */
+    for (i = 0; i < LOOKUP_THREADS; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, lookup_worker, &logmod));
+    }
+    for (i = 0; i < LOOKUP_THREADS; ++i) {
+        pthread_join(threads[i], &result);
+        ASSERT_EQ(NULL, result);
+    }
+    ASSERT_EQ(LOOKUP_CONTEXTS, logmod.length);
+
+    for (i = 0; i < LOOKUP_CONTEXTS; ++i) {
+        loggers[i] = logmod_get_logger(&logmod, lookup_ids[i]);
+        ASSERT_NEQ(NULL, loggers[i]);
+        ASSERT_STR_EQ(lookup_ids[i], loggers[i]->context_id);
+    }
+    /* same logger for equal context IDs, regardless of the pointer */
+    for (i = 0; i < LOOKUP_CONTEXTS; ++i) {
+        char context_id[16];
+        sprintf(context_id, "MODULE_%d", i);
+        ASSERT_EQ(loggers[i], logmod_get_logger(&logmod, context_id));
+    }
+    /* table is full */
+    ASSERT_EQ(NULL, logmod_get_logger(&logmod, "MODULE_NEW"));
+
+    PASS();
+}
+
+static void
+log_to_cached_logger(struct logmod *logmod, int i)
+{
+    logmod_nlog_context(INFO, logmod, "MODULE_A", ("Cached %d", i), 1);
+}
+
+TEST
+should_cache_logger_per_call_site(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    struct logmod_logger table[TABLE_LENGTH];
+    struct logmod_options options = { 0 };
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[256];
+    size_t bytes_read;
+
+    options.quiet = 1;
+    options.logfile = fp;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logmod_set_options(&logmod, options);
+    log_to_cached_logger(&logmod, 1);
+    log_to_cached_logger(&logmod, 2);
+    ASSERT_EQ(1, logmod.length);
+    ASSERT_STR_EQ("MODULE_A", table[0].context_id);
+
+    /* table is reinitialized, with another logger where the cached one was */
+    logmod_cleanup(&logmod);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logmod_set_options(&logmod, options);
+    ASSERT_EQ((void *)&table[0], logmod_get_logger(&logmod, "MODULE_B"));
+    log_to_cached_logger(&logmod, 3);
+    ASSERT_EQ(2, logmod.length);
+    ASSERT_STR_EQ("MODULE_A", table[1].context_id);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, "MODULE_A » INFO"));
+    ASSERT_NEQ(NULL, strstr(buffer, "Cached 3"));
+    ASSERT_EQ(NULL, strstr(buffer, "MODULE_B"));
+
+    logmod_cleanup(&logmod);
+    fclose(fp);
+    PASS();
+}
+
 /* Custom lock function for testing */
 static int lock_was_called = 0;
 static void
@@ -393,6 +556,7 @@ should_get_level_by_label_name(void)
     static const char *const context_id = "MODULE_A";
     struct logmod_logger table[TABLE_LENGTH], *logger;
     struct logmod logmod;
+    int original_stderr, null_fd;
     long level;
 
     logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
@@ -420,13 +584,2028 @@ should_get_level_by_label_name(void)
     level = logmod_logger_get_level(logger, "NONEXISTENT");
     ASSERT_EQ(LOGMOD_BAD_PARAMETER, level);
 
-    freopen("/dev/null", "w", stderr); /* disable stderr */
+    /* disable stderr, without a terminal to restore it from */
+    original_stderr = dup(STDERR_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
     level = logmod_logger_get_level(NULL, "INFO");
     ASSERT_EQ(LOGMOD_BAD_PARAMETER, level);
 
     level = logmod_logger_get_level(logger, NULL);
     ASSERT_EQ(LOGMOD_BAD_PARAMETER, level);
-    freopen("/dev/tty", "w", stderr); /* restore stderr */
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO); /* restore stderr */
+    close(original_stderr);
+    close(null_fd);
+
+    PASS();
+}
+
+TEST
+should_skip_filtered_levels_before_callback(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    logmod_err code;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_callback(logger, NULL, 0, test_callback);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_level(logger, LOGMOD_LEVEL_WARN);
+
+    callback_was_called = 0;
+    code = logmod_nlog(INFO, logger, ("Filtered message"), 0);
+    ASSERT_EQ(LOGMOD_OK_SKIPPED, code);
+    ASSERT_EQ(0, callback_was_called);
+    ASSERT_EQ(0, logmod.counter);
+
+    code = logmod_nlog(WARN, logger, ("Accepted message"), 0);
+    ASSERT_EQ(LOGMOD_OK, code);
+    ASSERT_EQ(1, callback_was_called);
+    ASSERT_EQ(1, logmod.counter);
+
+    logmod_toggle_logger(&logmod, context_id);
+    callback_was_called = 0;
+    code = logmod_nlog(FATAL, logger, ("Disabled message"), 0);
+    ASSERT_EQ(LOGMOD_OK_SKIPPED, code);
+    ASSERT_EQ(0, callback_was_called);
+
+    PASS();
+}
+
+TEST
+should_forward_filtered_levels_to_opted_in_callback(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    struct logmod_options options = { 0 };
+    FILE *fp = tmpfile();
+    char buffer[256];
+    size_t bytes_read;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    options.logfile = fp;
+    options.quiet = 1;
+    options.level = LOGMOD_LEVEL_WARN;
+    options.callback_all_levels = 1;
+    logmod_logger_set_options(logger, options);
+    logmod_logger_set_callback(logger, NULL, 0, continue_callback);
+
+    callback_was_called = 0;
+    last_label = NULL;
+    logmod_nlog(DEBUG, logger, ("Seen by callback only"), 0);
+    ASSERT_EQ(1, callback_was_called);
+    ASSERT_STR_EQ("DEBUG", last_label);
+
+    /* default output still honors the logger level */
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_EQ(0, bytes_read);
+
+    logmod_nlog(WARN, logger, ("Seen by both"), 0);
+    ASSERT_STR_EQ("WARN", last_label);
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, "Seen by both"));
+
+    PASS();
+}
+
+TEST
+should_write_records_larger_than_buffer(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    static char payload[LOGMOD_BUFFER_SIZE * 2];
+    static char buffer[LOGMOD_BUFFER_SIZE * 3];
+    size_t bytes_read;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+
+    logmod_nlog(INFO, logger, ("<%s>", payload), 1);
+    logmod_nlog(INFO, logger, ("Short message"), 0);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, payload));
+    ASSERT_NEQ(NULL, strstr(buffer, ">\n"));
+    ASSERT_NEQ(NULL, strstr(buffer, "Short message\n"));
+
+    PASS();
+}
+
+TEST
+should_share_formatted_message_with_callback(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[256];
+    size_t bytes_read;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_callback(logger, NULL, 0, message_callback);
+
+    memset(last_formatted, 0, sizeof(last_formatted));
+    logmod_nlog(INFO, logger, ("%s = %d", "answer", 42), 2);
+    ASSERT_STR_EQ("answer = 42", last_formatted);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, "INFO"));
+    ASSERT_NEQ(NULL, strstr(buffer, ": answer = 42\n"));
+
+    PASS();
+}
+
+TEST
+should_format_like_printf(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    char expected[256];
+    int written;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_callback(logger, NULL, 0, message_callback);
+
+    /* rendered natively */
+    logmod_nlog(INFO, logger,
+                ("[%d|%-5i|%+04d|% d|%u|%.3u|%x|%#X|%08lx|%ld|%lu|%hhd|%zu]",
+                 -42, 7, 9, 3, 4000000000u, 5u, 255u, 255u, 0xbeefUL,
+                 -1234567890L, 987654321UL, 300, (size_t)12),
+                13);
+    sprintf(expected,
+            "[%d|%-5i|%+04d|% d|%u|%.3u|%x|%#X|%08lx|%ld|%lu|%d|%lu]", -42, 7,
+            9, 3, 4000000000u, 5u, 255u, 255u, 0xbeefUL, -1234567890L,
+            987654321UL, (signed char)300, (unsigned long)12);
+    ASSERT_STR_EQ(expected, last_formatted);
+
+    logmod_nlog(INFO, logger,
+                ("[%f|%.2f|%-9.3f|%+.1f|%010.4f|%.0f|%#.0f|%.*f|%*s|%.2s|%c]",
+                 3.14159, -2.5, 1e-3, 99.95, -123.456, 2.5, 7.0, 3, 0.0625,
+                 -6, "ab", "xyz", '!'),
+                13);
+    sprintf(expected,
+            "[%f|%.2f|%-9.3f|%+.1f|%010.4f|%.0f|%#.0f|%.*f|%*s|%.2s|%c]",
+            3.14159, -2.5, 1e-3, 99.95, -123.456, 2.5, 7.0, 3, 0.0625, -6,
+            "ab", "xyz", '!');
+    ASSERT_STR_EQ(expected, last_formatted);
+
+    /* left to printf(), entirely or from the first unknown conversion */
+    logmod_nlog(INFO, logger,
+                ("[%e|%g|%o|%-8p|%f|%s|%d%n|%d]", 1.5e-7, 0.1, 8u,
+                 (void *)&logmod, 1e20, (char *)NULL, 1, &written, 2),
+                9);
+    sprintf(expected, "[%e|%g|%o|%-8p|%f|%s|%d", 1.5e-7, 0.1, 8u,
+            (void *)&logmod, 1e20, "(null)", 1);
+    ASSERT_EQ((int)strlen(expected), written);
+    strcat(expected, "|2]");
+    ASSERT_STR_EQ(expected, last_formatted);
+
+    PASS();
+}
+
+TEST
+should_cache_rendered_time(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[256], expected[sizeof "YYYY-MM-DDTHH:MM:SS"];
+    size_t bytes_read;
+    time_t before;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+
+    ASSERT_EQ(0, logmod.time_cache.generation);
+    before = time(NULL);
+    logmod_nlog(INFO, logger, ("First message"), 0);
+    ASSERT_EQ(0, logmod.time_cache.generation % 2);
+    ASSERT_GT(logmod.time_cache.generation, 0);
+    ASSERT(logmod.time_cache.second >= before);
+    ASSERT(logmod.time_cache.second <= time(NULL));
+
+    strftime(expected, sizeof expected, "%Y-%m-%dT%H:%M:%S",
+             localtime(&logmod.time_cache.second));
+    ASSERT_MEM_EQ(expected, logmod.time_cache.text, sizeof(expected) - 1);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, expected + 11));
+
+    PASS();
+}
+
+TEST
+should_timestamp_with_clock_sources(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    static const enum logmod_clocks sources[] = {
+        LOGMOD_CLOCK_REALTIME, LOGMOD_CLOCK_REALTIME_COARSE,
+        LOGMOD_CLOCK_MONOTONIC, LOGMOD_CLOCK_TSC
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    logmod_uint64 previous;
+    size_t i;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_callback(logger, NULL, 0, message_callback);
+
+    for (i = 0; i < sizeof(sources) / sizeof *sources; ++i) {
+        const logmod_uint64 now =
+            (logmod_uint64)time(NULL) * 1000000000UL;
+        if (logmod_set_clock(&logmod, sources[i]) != LOGMOD_OK) {
+            continue; /* not available on this platform */
+        }
+        logmod_nlog(INFO, logger, ("First"), 0);
+        previous = last_timestamp;
+        ASSERT(last_timestamp + 2000000000UL > now);
+        ASSERT(last_timestamp < now + 2000000000UL);
+        logmod_nlog(INFO, logger, ("Second"), 0);
+        if (sources[i] != LOGMOD_CLOCK_REALTIME
+            && sources[i] != LOGMOD_CLOCK_REALTIME_COARSE)
+        {
+            ASSERT(last_timestamp >= previous);
+        }
+    }
+
+    PASS();
+}
+
+TEST
+should_render_time_formats(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[512], date[sizeof "YYYY-MM-DDT"];
+    size_t bytes_read;
+    char *found;
+    time_t now;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_counter(logger, 0);
+
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_set_time_format(logger,
+                                                       LOGMOD_TIME_HMS_USEC));
+    logmod_nlog(INFO, logger, ("Microseconds"), 0);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_logger_set_time_format(logger, LOGMOD_TIME_ISO8601));
+    now = time(NULL);
+    logmod_nlog(INFO, logger, ("ISO-8601"), 0);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    /* HH:MM:SS.uuuuuu */
+    ASSERT_EQ(':', buffer[2]);
+    ASSERT_EQ('.', buffer[8]);
+    ASSERT_EQ(' ', buffer[15]);
+    /* YYYY-MM-DDTHH:MM:SS.uuuuuu+hh:mm */
+    strftime(date, sizeof date, "%Y-%m-%dT", localtime(&now));
+    ASSERT_NEQ(NULL, found = strstr(buffer, date));
+    ASSERT_EQ('.', found[19]);
+    ASSERT(found[26] == '+' || found[26] == '-');
+    ASSERT_EQ(' ', found[32]);
+
+    PASS();
+}
+
+TEST
+should_carry_sequence_number_in_info(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[512];
+    size_t bytes_read;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_callback(logger, NULL, 0, message_callback);
+
+    logmod_nlog(INFO, logger, ("First"), 0);
+    ASSERT_EQ(0, last_counter);
+    logmod_nlog(INFO, logger, ("Second"), 0);
+    ASSERT_EQ(1, last_counter);
+    ASSERT_EQ(2, logmod_logger_get_counter(logger));
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_EQ(0, strncmp(buffer, "0   ", 4));
+    ASSERT_NEQ(NULL, strstr(buffer, "\n1   "));
+
+    PASS();
+}
+
+#define ASYNC_THREADS  4
+#define ASYNC_MESSAGES 500
+
+static void *
+async_producer(void *arg)
+{
+    struct logmod_logger *logger = arg;
+    int i;
+    for (i = 0; i < ASYNC_MESSAGES; ++i) {
+        logmod_nlog(INFO, logger, ("Message %d", i), 1);
+    }
+    return NULL;
+}
+
+TEST
+should_log_asynchronously(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    static char buffer[ASYNC_THREADS * ASYNC_MESSAGES * 64 + 4096];
+    static char payload[LOGMOD_ASYNC_SLOT_SIZE * 4];
+    static int seen[ASYNC_THREADS * ASYNC_MESSAGES + 1];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[16];
+    struct logmod_async async;
+    struct logmod logmod;
+    pthread_t threads[ASYNC_THREADS];
+    FILE *fp = tmpfile();
+    size_t bytes_read;
+    char *line;
+    int i;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    memset(seen, 0, sizeof seen);
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+
+    /* spans several slots, and has to wait for the queue to drain */
+    logmod_nlog(INFO, logger, ("<%s>", payload), 1);
+    for (i = 0; i < ASYNC_THREADS; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, async_producer, logger));
+    }
+    for (i = 0; i < ASYNC_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_NEQ(NULL, strstr(buffer, payload));
+    for (line = buffer; *line; line = strchr(line, '\n') + 1) {
+        const long counter = strtol(line, NULL, 10);
+        ASSERT(counter >= 0 && counter < (long)(sizeof(seen) / sizeof *seen));
+        ++seen[counter];
+    }
+    for (i = 0; i < (int)(sizeof(seen) / sizeof *seen); ++i) {
+        ASSERT_EQ(1, seen[i]);
+    }
+
+    ASSERT_EQ(LOGMOD_OK, logmod_stop_async(&logmod));
+    ASSERT_EQ(NULL, logmod.async);
+    logmod_cleanup(&logmod);
+    fclose(fp);
+    PASS();
+}
+
+TEST
+should_drain_async_queue_on_cleanup(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[64];
+    struct logmod_async async;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[8192];
+    size_t bytes_read;
+    int i, lines = 0;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+    for (i = 0; i < 100; ++i) {
+        logmod_nlog(INFO, logger, ("Queued %d", i), 1);
+    }
+    logmod_cleanup(&logmod);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    for (i = 0; i < (int)bytes_read; ++i) {
+        lines += buffer[i] == '\n';
+    }
+    ASSERT_EQ(100, lines);
+    ASSERT_NEQ(NULL, strstr(buffer, "Queued 99\n"));
+
+    fclose(fp);
+    PASS();
+}
+
+TEST
+should_defer_formatting_to_async_writer(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[64];
+    struct logmod_async async;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char name[] = "original", expected[512], buffer[1024];
+    size_t bytes_read;
+    int value = -42;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_counter(logger, 0);
+    logmod_logger_set_time(logger, 0);
+    logmod_logger_set_defer_formatting(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+
+    logmod_nlog(INFO, logger,
+                ("[%d|%5.2f|%-10s|%x|%lu|%c|%p|%%|%*d|%.*s|%hhd|%e|%s]", value,
+                 3.14159, name, 255u, 123456789UL, 'z', (void *)name, 6, 7, 3,
+                 "truncated", 300, 1e-5, (char *)NULL),
+                14);
+    /* strings are captured by value */
+    strcpy(name, "modified");
+    logmod_flush(&logmod);
+
+    sprintf(expected,
+            "[%d|%5.2f|%-10s|%x|%lu|%c|%p|%%|%*d|%.*s|%d|%e|%s]\n", value,
+            3.14159, "original", 255u, 123456789UL, 'z', (void *)name, 6, 7,
+            3, "truncated", 44, 1e-5, "(null)");
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    ASSERT_STR_EQ(expected, strchr(buffer, '['));
+
+    logmod_cleanup(&logmod);
+    fclose(fp);
+    PASS();
+}
+
+TEST
+should_write_binary_records(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_binary_site sites[8];
+    struct logmod_binary binary;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[1024];
+    long sizes[3];
+    int i;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_binary_init(&binary, fp, sites,
+                                            sizeof(sites) / sizeof *sites));
+    logmod_logger_set_binary(logger, &binary);
+
+    sizes[0] = ftell(fp);
+    for (i = 0; i < 2; ++i) {
+        logmod_nlog(INFO, logger, ("Binary record number %d of the test", i),
+                    1);
+        sizes[i + 1] = ftell(fp);
+    }
+
+    rewind(fp);
+    ASSERT_EQ((size_t)sizes[2], fread(buffer, 1, sizeof(buffer), fp));
+    ASSERT_MEM_EQ("LOGMOD", buffer, 6);
+    ASSERT_EQ(LOGMOD_BINARY_VERSION, buffer[6]);
+    /* call site is described once, then referred to by its ID */
+    ASSERT_EQ('S', buffer[sizes[0]]);
+    ASSERT_EQ('R', buffer[sizes[1]]);
+    ASSERT(sizes[2] - sizes[1] < (long)sizeof("Binary record number %d"));
+
+    logmod_cleanup(&logmod);
+    fclose(fp);
+    PASS();
+}
+
+/* bytes that reached the file, as opposed to its stdio buffer */
+static long
+written_size(FILE *fp)
+{
+    return (long)lseek(fileno(fp), 0, SEEK_END);
+}
+
+TEST
+should_flush_logfile_as_per_policy(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger, *other;
+    struct logmod_flush_policy policy = { 0 };
+    struct logmod_async_slot slots[16];
+    struct logmod_binary_site sites[4];
+    struct logmod_binary binary;
+    struct logmod_async async;
+    struct logmod logmod;
+    FILE *fp = tmpfile(), *binary_fp = tmpfile(), *full;
+    int original_stderr, null_fd;
+    long size;
+    int i;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_logfile(logger, fp);
+    logmod_logger_set_quiet(logger, 1);
+
+    logmod_nlog(INFO, logger, ("Flushed at once"), 0);
+    ASSERT_GT(written_size(fp), 0);
+
+    /* every 3 records, or at once from WARN */
+    policy.records = 3;
+    policy.level = LOGMOD_LEVEL_WARN;
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_set_flush_policy(logger, policy));
+    size = written_size(fp);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    ASSERT_EQ(size, written_size(fp));
+    logmod_nlog(INFO, logger, ("Third record"), 0);
+    ASSERT_GT(written_size(fp), size);
+    size = written_size(fp);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    ASSERT_EQ(size, written_size(fp));
+    logmod_nlog(WARN, logger, ("Severe enough"), 0);
+    ASSERT_GT(written_size(fp), size);
+
+    /* by size */
+    policy.records = 0;
+    policy.level = 0;
+    policy.bytes = 4096;
+    logmod_logger_set_flush_policy(logger, policy);
+    size = written_size(fp);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    ASSERT_EQ(size, written_size(fp));
+    for (i = 0; i < 100 && written_size(fp) == size; ++i) {
+        logmod_nlog(INFO, logger, ("Filling up %d", i), 1);
+    }
+    ASSERT_GT(written_size(fp), size);
+    ASSERT_LT(i, 100);
+
+    /* explicitly */
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    size = written_size(fp);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+    ASSERT_GT(written_size(fp), size);
+
+    /* loggers sharing a binary stream each count their own records */
+    other = logmod_get_logger(&logmod, "MODULE_B");
+    logmod_logger_set_quiet(other, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_binary_init(&binary, binary_fp, sites,
+                                            sizeof(sites) / sizeof *sites));
+    fflush(binary_fp);
+    policy.records = 3;
+    policy.bytes = 0;
+    logmod_logger_set_flush_policy(logger, policy);
+    logmod_logger_set_flush_policy(other, policy);
+    logmod_logger_set_binary(logger, &binary);
+    logmod_logger_set_binary(other, &binary);
+    size = written_size(binary_fp);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    logmod_nlog(INFO, logger, ("Held back"), 0);
+    logmod_nlog(INFO, other, ("Held back"), 0);
+    ASSERT_EQ(size, written_size(binary_fp));
+    logmod_nlog(INFO, logger, ("Third record"), 0);
+    ASSERT_GT(written_size(binary_fp), size);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+    logmod_logger_set_binary(logger, NULL);
+    logmod_logger_set_binary(other, NULL);
+
+    /* by age, with the asynchronous writer as the timer, including of
+       records written before it started (loggers are configured before,
+       as the test doesn't set a lock function) */
+    policy.records = 0;
+    policy.interval_ms = 20;
+    logmod_logger_set_flush_policy(logger, policy);
+    ASSERT_NEQ(NULL, full = fopen("/dev/full", "w"));
+    logmod_logger_set_logfile(other, full);
+    policy.interval_ms = 1;
+    logmod_logger_set_flush_policy(other, policy);
+    size = written_size(fp);
+    logmod_nlog(INFO, logger, ("Flushed later"), 0);
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+    for (i = 0; i < 200 && written_size(fp) == size; ++i) {
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, NULL);
+    }
+    ASSERT_GT(written_size(fp), size);
+    size = written_size(fp);
+    logmod_nlog(INFO, logger, ("Flushed later"), 0);
+    for (i = 0; i < 200 && written_size(fp) == size; ++i) {
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, NULL);
+    }
+    ASSERT_GT(written_size(fp), size);
+
+    /* failures of the writer's flushes are reported by the next flush */
+    original_stderr = dup(STDERR_FILENO); /* errors are logged */
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    logmod_nlog(INFO, other, ("Lost"), 0);
+    for (i = 0; i < 200 && LOGMOD_ATOMIC_LOAD(int, &async.error) == LOGMOD_OK;
+         ++i)
+    {
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, NULL);
+    }
+    ASSERT_EQ(LOGMOD_ERRNO, logmod_flush(&logmod));
+    ASSERT_EQ(LOGMOD_OK, logmod_stop_async(&logmod));
+    logmod_logger_set_logfile(other, NULL);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO);
+    close(original_stderr);
+    close(null_fd);
+    fclose(full);
+
+    logmod_cleanup(&logmod);
+    fclose(binary_fp);
+    fclose(fp);
+
+    PASS();
+}
+
+/* sink collecting lines in memory */
+struct memory_sink {
+    char lines[1024];
+    size_t length;
+    int flushes;
+    int closes;
+};
+
+static logmod_err
+memory_sink_write(struct logmod_sink *sink,
+                  const struct logmod_info *info,
+                  const char *line,
+                  size_t length)
+{
+    struct memory_sink *memory = sink->data;
+    (void)info;
+    if (memory->length + length >= sizeof memory->lines)
+        return LOGMOD_BAD_PARAMETER;
+    memcpy(memory->lines + memory->length, line, length);
+    memory->length += length;
+    memory->lines[memory->length] = '\0';
+    return LOGMOD_OK;
+}
+
+static logmod_err
+memory_sink_flush(struct logmod_sink *sink)
+{
+    ++((struct memory_sink *)sink->data)->flushes;
+    return LOGMOD_OK;
+}
+
+static void
+memory_sink_close(struct logmod_sink *sink)
+{
+    ++((struct memory_sink *)sink->data)->closes;
+}
+
+TEST
+should_dispatch_records_to_sinks(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable memory_vtable = {
+        memory_sink_write, memory_sink_flush, memory_sink_close, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger, *other;
+    struct memory_sink plain, structured;
+    struct logmod_sink plain_sink, structured_sink;
+    struct logmod logmod;
+    int original_stderr, null_fd;
+    logmod_err code;
+
+    memset(&plain, 0, sizeof plain);
+    memset(&structured, 0, sizeof structured);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    other = logmod_get_logger(&logmod, "MODULE_B");
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_quiet(other, 1);
+    logmod_logger_set_level(logger, LOGMOD_LEVEL_FATAL);
+
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&plain_sink, &memory_vtable, &plain,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&structured_sink, &memory_vtable, &structured,
+                               LOGMOD_LEVEL_WARN, LOGMOD_SINK_STRUCTURED));
+    structured_sink.flush.records = 2;
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &plain_sink));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &structured_sink));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(other, &structured_sink));
+
+    /* attached once per logger */
+    original_stderr = dup(STDERR_FILENO); /* errors are logged */
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    code = logmod_logger_add_sink(logger, &plain_sink);
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO);
+    close(original_stderr);
+    close(null_fd);
+    ASSERT_EQ(LOGMOD_BAD_PARAMETER, code);
+    ASSERT_EQ(2, logger->num_sinks);
+    ASSERT_EQ(1, plain_sink.refs);
+
+    /* below the logger's level, but not the plain sink's */
+    code = logmod_nlog(DEBUG, logger, ("Debug %d", 1), 1);
+    ASSERT_EQ(LOGMOD_OK, code);
+    ASSERT_NEQ(NULL, strstr(plain.lines, "DEBUG"));
+    ASSERT_NEQ(NULL, strstr(plain.lines, "Debug 1\n"));
+    ASSERT_EQ(NULL, strchr(plain.lines, '\x1b'));
+    ASSERT_EQ(1, plain.flushes);
+    ASSERT_EQ(0, structured.length);
+
+    logmod_nlog(WARN, logger, ("Say \"%s\"\t%d", "hi", 2), 2);
+    ASSERT_NEQ(NULL, strstr(plain.lines, "Say \"hi\"\t2\n"));
+    ASSERT_NEQ(NULL, strstr(structured.lines, "\"level\":\"WARN\""));
+    ASSERT_NEQ(NULL, strstr(structured.lines, "\"application\":\""
+                                              "APPLICATION_A\""));
+    ASSERT_NEQ(NULL, strstr(structured.lines, "\"context\":\"MODULE_A\""));
+    ASSERT_NEQ(NULL,
+               strstr(structured.lines, "\"message\":\"Say \\\"hi\\\"\\t2\"}\n"));
+    ASSERT_EQ('{', structured.lines[0]);
+    ASSERT_EQ(0, structured.flushes);
+    logmod_nlog(WARN, other, ("Second"), 0);
+    ASSERT_NEQ(NULL, strstr(structured.lines, "\"context\":\"MODULE_B\""));
+    ASSERT_EQ(1, structured.flushes);
+
+    /* closed once detached from every logger */
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_remove_sink(logger, &structured_sink));
+    ASSERT_EQ(0, structured.closes);
+    logmod_nlog(INFO, logger, ("Plain only"), 0);
+    ASSERT_EQ(NULL, strstr(structured.lines, "Plain only"));
+    logmod_cleanup(&logmod);
+    ASSERT_EQ(1, structured.closes);
+    ASSERT_EQ(1, plain.closes);
+
+    PASS();
+}
+
+/* memory sink whose writes wait for the test to open the gate */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open, gate_entered;
+
+static logmod_err
+gated_sink_write(struct logmod_sink *sink,
+                 const struct logmod_info *info,
+                 const char *line,
+                 size_t length)
+{
+    pthread_mutex_lock(&gate_lock);
+    gate_entered = 1;
+    pthread_cond_broadcast(&gate_cond);
+    while (!gate_open)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+    return memory_sink_write(sink, info, line, length);
+}
+
+TEST
+should_apply_async_overflow_policy(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable gated_vtable = {
+        gated_sink_write, NULL, NULL, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[8];
+    struct logmod_async async;
+    struct memory_sink memory;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    char expected[32];
+    int i;
+
+    memset(&memory, 0, sizeof memory);
+    gate_open = gate_entered = 0;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_counter(logger, 0);
+    logmod_logger_set_time(logger, 0);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&sink, &gated_vtable, &memory,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_set_overflow_policy(&logmod, LOGMOD_OVERFLOW_DROP_NEWEST,
+                                         0));
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+
+    /* stall the writer on the first record, then fill the queue */
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 0), 1));
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_entered)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+    for (i = 1; i <= 8; ++i) {
+        ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", i), 1));
+    }
+
+    ASSERT_EQ(LOGMOD_OK_SKIPPED,
+              logmod_nlog(INFO, logger, ("Record %d", -1), 1));
+    ASSERT_EQ(LOGMOD_OK_SKIPPED,
+              logmod_nlog(WARN, logger, ("Record %d", -1), 1));
+    ASSERT_EQ(1, logmod_logger_get_dropped(logger, LOGMOD_LEVEL_INFO));
+    ASSERT_EQ(1, logmod_logger_get_dropped(logger, LOGMOD_LEVEL_WARN));
+
+    /* records 1 and 2 make room */
+    logmod_set_overflow_policy(&logmod, LOGMOD_OVERFLOW_DROP_OLDEST, 0);
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 9), 1));
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 10), 1));
+    ASSERT_EQ(3, logmod_logger_get_dropped(logger, LOGMOD_LEVEL_INFO));
+
+    logmod_set_overflow_policy(&logmod, LOGMOD_OVERFLOW_DROP_BELOW,
+                               LOGMOD_LEVEL_WARN);
+    ASSERT_EQ(LOGMOD_OK_SKIPPED,
+              logmod_nlog(DEBUG, logger, ("Record %d", -1), 1));
+    ASSERT_EQ(1, logmod_logger_get_dropped(logger, LOGMOD_LEVEL_DEBUG));
+    ASSERT_EQ(0, logmod_logger_get_dropped(logger, LOGMOD_LEVEL_ERROR));
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+
+    ASSERT_EQ(NULL, strstr(memory.lines, "Record -1\n"));
+    ASSERT_EQ(NULL, strstr(memory.lines, "Record 1\n"));
+    ASSERT_EQ(NULL, strstr(memory.lines, "Record 2\n"));
+    for (i = 3; i <= 10; ++i) {
+        sprintf(expected, "Record %d\n", i);
+        ASSERT_NEQ(NULL, strstr(memory.lines, expected));
+    }
+    ASSERT_NEQ(NULL, strstr(memory.lines, "WARN"));
+    ASSERT_NEQ(NULL, strstr(memory.lines, "5 records dropped\n"));
+
+    logmod_cleanup(&logmod);
+    PASS();
+}
+
+#define OVERFLOW_THREADS 4
+#define OVERFLOW_RECORDS 2000
+
+/* sink checking that each record is intact, see overflow_payload_length() */
+static int overflow_intact, overflow_torn;
+
+static size_t
+overflow_payload_length(int number)
+{
+    return (size_t)(number * 7 % 300);
+}
+
+static logmod_err
+checking_sink_write(struct logmod_sink *sink,
+                    const struct logmod_info *info,
+                    const char *line,
+                    size_t length)
+{
+    const char *record = strstr(line, "Record ");
+    int number = -1;
+    size_t i = 0;
+    (void)sink;
+    (void)info;
+    if (strstr(line, " dropped\n")) return LOGMOD_OK;
+    if (record && sscanf(record, "Record %d ", &number) == 1 && number >= 0)
+    {
+        record = strchr(record + sizeof "Record", ' ') + 1;
+        while (record[i] == 'x')
+            ++i;
+    }
+    if (number >= 0 && i == overflow_payload_length(number)
+        && record + i + 1 == line + length && record[i] == '\n')
+    {
+        ++overflow_intact;
+    }
+    else {
+        ++overflow_torn;
+    }
+    return LOGMOD_OK;
+}
+
+static void *
+overflow_producer(void *arg)
+{
+    static char payload[300];
+    struct logmod_logger *logger = arg;
+    int i;
+    memset(payload, 'x', sizeof payload);
+    for (i = 0; i < OVERFLOW_RECORDS; ++i) {
+        logmod_nlog(INFO, logger,
+                    ("Record %d %.*s", i, (int)overflow_payload_length(i),
+                     payload),
+                    3);
+    }
+    return NULL;
+}
+
+TEST
+should_drop_oldest_records_under_concurrent_producers(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable checking_vtable = {
+        checking_sink_write, NULL, NULL, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[8];
+    struct logmod_async async;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    pthread_t threads[OVERFLOW_THREADS];
+    int i;
+
+    overflow_intact = overflow_torn = 0;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&sink, &checking_vtable, NULL,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_set_overflow_policy(&logmod, LOGMOD_OVERFLOW_DROP_OLDEST,
+                                         0));
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+
+    /* records span several slots, reused by producers while being read */
+    for (i = 0; i < OVERFLOW_THREADS; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, overflow_producer,
+                                    logger));
+    }
+    for (i = 0; i < OVERFLOW_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+
+    ASSERT_EQ(0, overflow_torn);
+    ASSERT_EQ(OVERFLOW_THREADS * OVERFLOW_RECORDS,
+              overflow_intact
+                  + (int)logmod_logger_get_dropped(logger, LOGMOD_LEVEL_INFO));
+
+    logmod_cleanup(&logmod);
+    PASS();
+}
+
+TEST
+should_prioritize_severe_records(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable gated_vtable = {
+        gated_sink_write, NULL, NULL, NULL
+    };
+    static const struct logmod_sink_vtable memory_vtable = {
+        memory_sink_write, memory_sink_flush, memory_sink_close, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger, *other;
+    struct logmod_async_slot slots[8], priority_slots[4];
+    struct logmod_async async;
+    struct memory_sink memory, other_memory;
+    struct logmod_sink sink, other_sink;
+    struct logmod logmod;
+    char *urgent;
+    int i;
+
+    memset(&memory, 0, sizeof memory);
+    memset(&other_memory, 0, sizeof other_memory);
+    gate_open = gate_entered = 0;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    other = logmod_get_logger(&logmod, "MODULE_B");
+    logmod_logger_set_quiet(logger, 1);
+    logmod_logger_set_quiet(other, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&sink, &gated_vtable, &memory,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&other_sink, &memory_vtable, &other_memory,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    other_sink.flush.records = 100;
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(other, &other_sink));
+    ASSERT_EQ(LOGMOD_OK, logmod_set_priority(&logmod, LOGMOD_LEVEL_WARN,
+                                             LOGMOD_LEVEL_CUSTOM));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_start_async_priority(
+                  &logmod, &async, slots, sizeof(slots) / sizeof *slots,
+                  priority_slots,
+                  sizeof(priority_slots) / sizeof *priority_slots));
+
+    /* stall the writer on the first record, then queue a burst */
+    logmod_nlog(INFO, logger, ("Record %d", 0), 1);
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_entered)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+    for (i = 1; i <= 3; ++i) {
+        logmod_nlog(INFO, logger, ("Record %d", i), 1);
+    }
+    logmod_nlog(WARN, logger, ("Urgent"), 0);
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+
+    urgent = strstr(memory.lines, "Urgent\n");
+    ASSERT_NEQ(NULL, urgent);
+    ASSERT(strstr(memory.lines, "Record 0\n") < urgent);
+    ASSERT(urgent < strstr(memory.lines, "Record 1\n"));
+    ASSERT(strstr(memory.lines, "Record 1\n")
+           < strstr(memory.lines, "Record 3\n"));
+
+    /* written and flushed before the call returns */
+    logmod_set_priority(&logmod, LOGMOD_LEVEL_WARN, LOGMOD_LEVEL_WARN);
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(WARN, other, ("Synchronous"), 0));
+    ASSERT_NEQ(NULL, strstr(other_memory.lines, "Synchronous\n"));
+    ASSERT_EQ(1, other_memory.flushes);
+
+    logmod_cleanup(&logmod);
+    PASS();
+}
+
+/* producing thread logging through a staging buffer of its own */
+struct staged_producer {
+    struct logmod *logmod;
+    struct logmod_logger *logger;
+    struct logmod_async_staging staging;
+    struct logmod_async_slot slots[4];
+    int number;
+};
+
+static void *
+staged_producer(void *arg)
+{
+    struct staged_producer *producer = arg;
+    if (logmod_async_register(producer->logmod, &producer->staging,
+                              producer->slots,
+                              sizeof(producer->slots)
+                                  / sizeof *producer->slots)
+            != LOGMOD_OK
+        || logmod_nlog(INFO, producer->logger,
+                       ("Record %d", producer->number), 1)
+               != LOGMOD_OK)
+    {
+        return arg;
+    }
+    return NULL;
+}
+
+TEST
+should_merge_staged_records_in_order(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable gated_vtable = {
+        gated_sink_write, NULL, NULL, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[8];
+    struct logmod_async async;
+    struct staged_producer producers[2];
+    struct memory_sink memory;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    pthread_t thread;
+    void *result;
+    int i;
+
+    memset(&memory, 0, sizeof memory);
+    gate_open = gate_entered = 0;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&sink, &gated_vtable, &memory,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_start_async(&logmod, &async, slots,
+                                 sizeof(slots) / sizeof *slots));
+
+    /* stall the writer, then interleave staged and shared records */
+    logmod_nlog(INFO, logger, ("Record %d", 0), 1);
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_entered)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+    for (i = 0; i < 2; ++i) {
+        producers[i].logmod = &logmod;
+        producers[i].logger = logger;
+        producers[i].number = 1 + 2 * i;
+        ASSERT_EQ(0, pthread_create(&thread, NULL, staged_producer,
+                                    &producers[i]));
+        pthread_join(thread, &result);
+        ASSERT_EQ(NULL, result);
+        logmod_nlog(INFO, logger, ("Record %d", 2 + 2 * i), 1);
+    }
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    ASSERT_EQ(LOGMOD_OK, logmod_flush(&logmod));
+
+    for (i = 0; i < 4; ++i) {
+        char current[16], next[16];
+        sprintf(current, "Record %d\n", i);
+        sprintf(next, "Record %d\n", i + 1);
+        ASSERT_NEQ(NULL, strstr(memory.lines, current));
+        ASSERT(strstr(memory.lines, current) < strstr(memory.lines, next));
+    }
+
+    logmod_cleanup(&logmod);
+    PASS();
+}
+
+#define SYNC_THREADS 2
+#define SYNC_RECORDS 500
+
+/* sink tracking the order severe records are written and flushed in */
+struct sync_sink {
+    pthread_mutex_t lock;
+    int before;
+    int severe;
+    int flushed_severe;
+    int out_of_order;
+};
+
+static logmod_err
+sync_sink_write(struct logmod_sink *sink,
+                const struct logmod_info *info,
+                const char *line,
+                size_t length)
+{
+    struct sync_sink *state = sink->data;
+    const char *message;
+    int number;
+    (void)info;
+    (void)length;
+    pthread_mutex_lock(&state->lock);
+    if ((message = strstr(line, "Before "))
+        && sscanf(message, "Before %d", &number) == 1)
+    {
+        state->before = number;
+    }
+    else if ((message = strstr(line, "Severe "))
+             && sscanf(message, "Severe %d", &number) == 1)
+    {
+        if (state->before != number) ++state->out_of_order;
+        state->severe = number;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return LOGMOD_OK;
+}
+
+static logmod_err
+sync_sink_flush(struct logmod_sink *sink)
+{
+    struct sync_sink *state = sink->data;
+    pthread_mutex_lock(&state->lock);
+    state->flushed_severe = state->severe;
+    pthread_mutex_unlock(&state->lock);
+    return LOGMOD_OK;
+}
+
+static void *
+sync_producer(void *arg)
+{
+    struct logmod_logger *logger = arg;
+    int i;
+    for (i = 0; i < SYNC_RECORDS; ++i) {
+        logmod_nlog(INFO, logger, ("Record %d", i), 1);
+    }
+    return NULL;
+}
+
+TEST
+should_write_sync_records_through_busy_writer(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const struct logmod_sink_vtable sync_vtable = {
+        sync_sink_write, sync_sink_flush, NULL, NULL
+    };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_async_slot slots[16];
+    struct logmod_async async;
+    struct sync_sink state;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    pthread_t threads[SYNC_THREADS];
+    int i, flushed_severe, out_of_order;
+
+    memset(&state, 0, sizeof state);
+    state.before = state.severe = state.flushed_severe = -1;
+    pthread_mutex_init(&state.lock, NULL);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init(&sink, &sync_vtable, &state,
+                               LOGMOD_LEVEL_DEBUG, LOGMOD_SINK_PLAIN));
+    sink.flush.records = 100000;
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(LOGMOD_OK, logmod_set_priority(&logmod, LOGMOD_LEVEL_CUSTOM,
+                                             LOGMOD_LEVEL_ERROR));
+    ASSERT_EQ(LOGMOD_OK, logmod_start_async(&logmod, &async, slots,
+                                            sizeof(slots) / sizeof *slots));
+
+    /* the writer stays busy with records of other threads */
+    for (i = 0; i < SYNC_THREADS; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, sync_producer,
+                                    logger));
+    }
+    for (i = 0; i < 20; ++i) {
+        logmod_nlog(WARN, logger, ("Before %d", i), 1);
+        ASSERT_EQ(LOGMOD_OK, logmod_nlog(ERROR, logger, ("Severe %d", i), 1));
+        pthread_mutex_lock(&state.lock);
+        flushed_severe = state.flushed_severe;
+        out_of_order = state.out_of_order;
+        pthread_mutex_unlock(&state.lock);
+        ASSERT_EQ(i, flushed_severe);
+        ASSERT_EQ(0, out_of_order);
+    }
+    for (i = 0; i < SYNC_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    logmod_cleanup(&logmod);
+    pthread_mutex_destroy(&state.lock);
+    PASS();
+}
+
+TEST
+should_write_records_to_file_descriptor(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char payload[LOGMOD_BUFFER_SIZE * 2];
+    static char buffer[sizeof payload + 1024];
+    struct logmod_logger table[TABLE_LENGTH], *logger, *other;
+    struct logmod_sink sink, failing;
+    struct logmod logmod;
+    FILE *fp = tmpfile(), *log_fp;
+    const int fd = fileno(fp);
+    int read_only, original_stderr, error;
+    ssize_t bytes_read;
+    logmod_err code;
+    char *line;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_fd(&sink, fd, LOGMOD_LEVEL_INFO,
+                                             LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Small %d", 1), 1));
+    /* larger than the record buffer, written whole */
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger,
+                                     ("Large <%s> %d%%", payload, 2), 2));
+    logmod_nlog(DEBUG, logger, ("Filtered"), 0);
+
+    /* fails without logging, errno intact */
+    ASSERT((read_only = open("/dev/null", O_RDONLY)) >= 0);
+    other = logmod_get_logger(&logmod, "MODULE_B");
+    logmod_logger_set_quiet(other, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_fd(&failing, read_only,
+                                             LOGMOD_LEVEL_INFO,
+                                             LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(other, &failing));
+    original_stderr = dup(STDERR_FILENO);
+    log_fp = tmpfile();
+    dup2(fileno(log_fp), STDERR_FILENO);
+    errno = 0;
+    code = logmod_nlog(INFO, other, ("Lost"), 0);
+    error = errno;
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO);
+    close(original_stderr);
+    ASSERT_EQ(LOGMOD_ERRNO, code);
+    ASSERT_EQ(EBADF, error);
+    ASSERT_EQ(0, lseek(fileno(log_fp), 0, SEEK_END));
+    fclose(log_fp);
+    logmod_cleanup(&logmod);
+    close(read_only);
+
+    lseek(fd, 0, SEEK_SET);
+    bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    ASSERT_GT(bytes_read, 0);
+    buffer[bytes_read] = '\0';
+    line = strstr(buffer, "INFO");
+    ASSERT_NEQ(NULL, line);
+    ASSERT_NEQ(NULL, strstr(line, ": Small 1\n"));
+    line = strstr(line + 1, "INFO");
+    ASSERT_NEQ(NULL, line);
+    line = strstr(line, ": Large <");
+    ASSERT_NEQ(NULL, line);
+    line += sizeof ": Large <" - 1;
+    ASSERT_MEM_EQ(payload, line, sizeof(payload) - 1);
+    ASSERT_STR_EQ("> 2%\n", line + sizeof(payload) - 1);
+    fclose(fp);
+
+    PASS();
+}
+
+TEST
+should_append_records_to_memory_mapped_file(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char payload[LOGMOD_BUFFER_SIZE * 2];
+    static char buffer[64 * 1024];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_sink sink;
+    struct logmod_mmap map;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    const int fd = fileno(fp);
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    ssize_t bytes_read;
+    char *line;
+    int i, lines;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    ASSERT_EQ(5, write(fd, "HEAD\n", 5));
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_mmap(&sink, &map, fd, page_size,
+                                               LOGMOD_LEVEL_INFO,
+                                               LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+
+    /* spans more windows than are mapped at once */
+    for (i = 0; i < 400; ++i)
+        ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", i), 1));
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger,
+                                     ("Large <%s>", payload), 1));
+    logmod_nlog(DEBUG, logger, ("Filtered"), 0);
+    logmod_cleanup(&logmod);
+
+    /* truncated to what was written, after the file's former contents */
+    ASSERT_EQ((off_t)map.offset, lseek(fd, 0, SEEK_END));
+    lseek(fd, 0, SEEK_SET);
+    bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    ASSERT_EQ((ssize_t)map.offset, bytes_read);
+    buffer[bytes_read] = '\0';
+    ASSERT_EQ(0, strncmp(buffer, "HEAD\n", 5));
+    ASSERT_EQ('\n', buffer[bytes_read - 1]);
+    for (line = buffer, lines = 0; (line = strchr(line, '\n')); ++line)
+        ++lines;
+    ASSERT_EQ(1 + 400 + 1, lines);
+    ASSERT_NEQ(NULL, strstr(buffer, ": Record 0\n"));
+    ASSERT_NEQ(NULL, strstr(buffer, ": Record 399\n"));
+    line = strstr(buffer, ": Large <");
+    ASSERT_NEQ(NULL, line);
+    line += sizeof ": Large <" - 1;
+    ASSERT_MEM_EQ(payload, line, sizeof(payload) - 1);
+    ASSERT_STR_EQ(">\n", line + sizeof(payload) - 1);
+    ASSERT_EQ(NULL, strstr(buffer, "Filtered"));
+    fclose(fp);
+
+    PASS();
+}
+
+#define MMAP_THREADS 4
+#define MMAP_RECORDS 500
+
+struct mmap_producer {
+    struct logmod_logger *logger;
+    int id;
+    int failures;
+};
+
+static void *
+mmap_producer(void *arg)
+{
+    struct mmap_producer *producer = arg;
+    int i;
+    for (i = 0; i < MMAP_RECORDS; ++i) {
+        if (logmod_nlog(INFO, producer->logger,
+                        ("Record %d %d", producer->id, i), 2)
+            != LOGMOD_OK)
+        {
+            ++producer->failures;
+        }
+    }
+    return NULL;
+}
+
+TEST
+should_reserve_memory_mapped_file_space_across_threads(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char seen[MMAP_THREADS][MMAP_RECORDS];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct mmap_producer producers[MMAP_THREADS];
+    pthread_t threads[MMAP_THREADS];
+    struct logmod_sink sink;
+    struct logmod_mmap map;
+    struct logmod logmod;
+    struct rlimit limit, lowered;
+    void (*handler)(int);
+    FILE *fp = tmpfile();
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char *buffer, *line, *next;
+    int failures, original_stderr, null_fd, i, j;
+
+    /* every record in one piece, and exactly once */
+    memset(seen, 0, sizeof seen);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_mmap(&sink, &map, fileno(fp),
+                                               page_size, LOGMOD_LEVEL_INFO,
+                                               LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    for (i = 0; i < MMAP_THREADS; ++i) {
+        producers[i].logger = logger;
+        producers[i].id = i;
+        producers[i].failures = 0;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, mmap_producer,
+                                    &producers[i]));
+    }
+    for (i = 0; i < MMAP_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        ASSERT_EQ(0, producers[i].failures);
+    }
+    logmod_cleanup(&logmod);
+    ASSERT_EQ(0, map.lost);
+    ASSERT_EQ((off_t)map.offset, lseek(fileno(fp), 0, SEEK_END));
+    buffer = malloc((size_t)map.offset + 1);
+    ASSERT_NEQ(NULL, buffer);
+    lseek(fileno(fp), 0, SEEK_SET);
+    ASSERT_EQ((ssize_t)map.offset,
+              read(fileno(fp), buffer, (size_t)map.offset));
+    buffer[map.offset] = '\0';
+    for (line = buffer; (next = strchr(line, '\n')); line = next + 1) {
+        const char *record = strstr(line, ": Record ");
+        ASSERT(record != NULL && record < next);
+        ASSERT_EQ(2, sscanf(record, ": Record %d %d", &i, &j));
+        ASSERT(i >= 0 && i < MMAP_THREADS && j >= 0 && j < MMAP_RECORDS);
+        ASSERT_EQ(0, seen[i][j]++);
+    }
+    ASSERT_EQ('\0', *line);
+    for (i = 0; i < MMAP_THREADS; ++i)
+        for (j = 0; j < MMAP_RECORDS; ++j)
+            ASSERT_EQ(1, seen[i][j]);
+    free(buffer);
+    fclose(fp);
+
+    /* windows past the file size limit can't be mapped, no thread waits
+     * for their records */
+    fp = tmpfile();
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_mmap(&sink, &map, fileno(fp),
+                                               page_size, LOGMOD_LEVEL_INFO,
+                                               LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &limit));
+    lowered = limit;
+    lowered.rlim_cur = (rlim_t)(4 * page_size);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &lowered));
+    handler = signal(SIGXFSZ, SIG_IGN);
+    original_stderr = dup(STDERR_FILENO); /* errors are logged */
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    for (i = 0; i < MMAP_THREADS; ++i) {
+        producers[i].logger = logger;
+        producers[i].id = i;
+        producers[i].failures = 0;
+        if (pthread_create(&threads[i], NULL, mmap_producer, &producers[i]))
+            break;
+    }
+    for (j = 0, failures = 0; j < i; ++j) {
+        pthread_join(threads[j], NULL);
+        failures += producers[j].failures;
+    }
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO);
+    close(original_stderr);
+    close(null_fd);
+    setrlimit(RLIMIT_FSIZE, &limit);
+    signal(SIGXFSZ, handler);
+    ASSERT_EQ(MMAP_THREADS, i);
+    logmod_cleanup(&logmod);
+    ASSERT_GT(failures, 0);
+    ASSERT_GT(map.lost, 0);
+    ASSERT_EQ(4 * page_size, map.offset - map.lost);
+    fclose(fp);
+
+    PASS();
+}
+
+TEST
+should_write_records_through_io_uring(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char payload[LOGMOD_BUFFER_SIZE * 2];
+    static char buffers[4][256];
+    static char buffer[64 * 1024];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_uring uring;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    const int fd = fileno(fp);
+    ssize_t bytes_read;
+    char expected[32], *line;
+    int i;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    ASSERT_EQ(5, write(fd, "HEAD\n", 5));
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init_uring(&sink, &uring, fd, buffers[0],
+                                     sizeof buffers[0], 4, LOGMOD_LEVEL_INFO,
+                                     LOGMOD_SINK_PLAIN));
+    sink.flush.records = 8; /* batched */
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+
+    /* more than the buffers hold at once, written in order */
+    for (i = 0; i < 200; ++i)
+        ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", i), 1));
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger,
+                                     ("Large <%s>", payload), 1));
+    logmod_cleanup(&logmod);
+    ASSERT_EQ(0, uring.error);
+
+    lseek(fd, 0, SEEK_SET);
+    bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    ASSERT_GT(bytes_read, 0);
+    buffer[bytes_read] = '\0';
+    ASSERT_EQ(0, strncmp(buffer, "HEAD\n", 5));
+    for (i = 0, line = buffer; i < 200; ++i) {
+        sprintf(expected, ": Record %d\n", i);
+        line = strstr(line, expected);
+        ASSERT_NEQ(NULL, line);
+    }
+    line = strstr(line, ": Large <");
+    ASSERT_NEQ(NULL, line);
+    line += sizeof ": Large <" - 1;
+    ASSERT_MEM_EQ(payload, line, sizeof(payload) - 1);
+    ASSERT_STR_EQ(">\n", line + sizeof(payload) - 1);
+    fclose(fp);
+
+    PASS();
+}
+
+TEST
+should_report_io_uring_write_errors(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char buffers[2][256];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_uring uring;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    const int fd = open("/dev/null", O_RDONLY);
+    logmod_err code = LOGMOD_OK;
+    int i;
+
+    ASSERT_GTE(fd, 0);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init_uring(&sink, &uring, fd, buffers[0],
+                                     sizeof buffers[0], 2, LOGMOD_LEVEL_INFO,
+                                     LOGMOD_SINK_PLAIN));
+    if (uring.ring_fd < 0) { /* writev() would log the error */
+        logmod_cleanup(&logmod);
+        close(fd);
+        SKIPm("io_uring unavailable");
+    }
+    sink.flush.interval_ms = 0;
+    sink.flush.level = 0; /* a write per record */
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+
+    /* returned by a later call, without logging */
+    for (i = 0; i < 4 && code == LOGMOD_OK; ++i)
+        code = logmod_nlog(INFO, logger, ("Record %d", i), 1);
+    ASSERT_EQ(LOGMOD_ERRNO, code);
+    ASSERT_EQ(EBADF, errno);
+    logmod_cleanup(&logmod);
+    close(fd);
+
+    PASS();
+}
+
+/* appends the record numbers found in `path` to `numbers` */
+static int
+read_record_numbers(const char *path, int *numbers, int *count)
+{
+    char line[256];
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    while (fgets(line, sizeof line, fp)) {
+        const char *record = strstr(line, ": Record ");
+        if (!record || line[strlen(line) - 1] != '\n') break;
+        numbers[(*count)++] = atoi(record + sizeof ": Record " - 1);
+    }
+    fclose(fp);
+    return 1;
+}
+
+/* waits for the rotation in progress, if any */
+static void
+wait_rotation(struct logmod_rotation *rotation)
+{
+    while (LOGMOD_ATOMIC_LOAD(int, &rotation->state)) {
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+TEST
+should_rotate_file_sink_by_size(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    struct logmod_rotation_policy policy = { 512, 0, 2 };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_rotation rotation;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    char dir[] = "/tmp/logmod-test-XXXXXX", path[64], rotated[80];
+    int numbers[200], count = 0, i;
+
+    ASSERT_NEQ(NULL, mkdtemp(dir));
+    sprintf(path, "%s/app.log", dir);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_rotating(&sink, &rotation, path,
+                                                   policy, LOGMOD_LEVEL_INFO,
+                                                   LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    for (i = 0; i < 100; ++i) {
+        ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", i), 1));
+        wait_rotation(&rotation);
+    }
+    logmod_cleanup(&logmod);
+
+    /* oldest first, no record lost or split across files */
+    sprintf(rotated, "%s.3", path);
+    ASSERT_EQ(0, read_record_numbers(rotated, numbers, &count));
+    sprintf(rotated, "%s.2", path);
+    ASSERT(read_record_numbers(rotated, numbers, &count));
+    ASSERT_GT(count, 0);
+    sprintf(rotated, "%s.1", path);
+    ASSERT(read_record_numbers(rotated, numbers, &count));
+    ASSERT(read_record_numbers(path, numbers, &count));
+    ASSERT_GT(count, 2);
+    ASSERT_EQ(99, numbers[count - 1]);
+    for (i = 1; i < count; ++i)
+        ASSERT_EQ(numbers[i - 1] + 1, numbers[i]);
+
+    unlink(path);
+    sprintf(rotated, "%s.1", path);
+    unlink(rotated);
+    sprintf(rotated, "%s.2", path);
+    unlink(rotated);
+    rmdir(dir);
+
+    PASS();
+}
+
+TEST
+should_rotate_file_sink_by_interval(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    struct logmod_rotation_policy policy = { 0, 1, 1 };
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_rotation rotation;
+    struct logmod_sink sink;
+    struct logmod logmod;
+    char dir[] = "/tmp/logmod-test-XXXXXX", path[64], rotated[80];
+    int numbers[8], count = 0;
+    logmod_uint64 deadline;
+
+    ASSERT_NEQ(NULL, mkdtemp(dir));
+    sprintf(path, "%s/app.log", dir);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK, logmod_sink_init_rotating(&sink, &rotation, path,
+                                                   policy, LOGMOD_LEVEL_INFO,
+                                                   LOGMOD_SINK_PLAIN));
+    sink.flush.records = 100; /* rotated by the write, not by a flush */
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+    deadline = rotation.deadline;
+    ASSERT_GT(deadline, 0);
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 0), 1));
+    while ((logmod_uint64)time(NULL) * LOGMOD_NSEC_PER_SEC < deadline) {
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, NULL);
+    }
+    /* the first record past the deadline starts the rotation */
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 1), 1));
+    wait_rotation(&rotation);
+    ASSERT_GT(rotation.deadline, deadline);
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, logger, ("Record %d", 2), 1));
+    logmod_cleanup(&logmod);
+
+    sprintf(rotated, "%s.1", path);
+    ASSERT(read_record_numbers(rotated, numbers, &count));
+    ASSERT_EQ(2, count);
+    ASSERT_EQ(0, numbers[0]);
+    ASSERT_EQ(1, numbers[1]);
+    ASSERT(read_record_numbers(path, numbers, &count));
+    ASSERT_EQ(3, count);
+    ASSERT_EQ(2, numbers[2]);
+
+    unlink(path);
+    unlink(rotated);
+    rmdir(dir);
+
+    PASS();
+}
+
+#define DURABLE_THREADS 4
+#define DURABLE_RECORDS 100
+
+static void *
+durable_producer(void *arg)
+{
+    struct logmod_logger *logger = arg;
+    int i;
+    for (i = 0; i < DURABLE_RECORDS; ++i) {
+        if (logmod_nlog(INFO, logger, ("Record %d", i), 1) != LOGMOD_OK)
+            return arg;
+    }
+    return NULL;
+}
+
+TEST
+should_commit_durable_records_in_groups(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char buffers[2][128], payload[150];
+    static int numbers[DURABLE_THREADS * DURABLE_RECORDS + 1];
+    struct logmod_logger table[TABLE_LENGTH], *logger, *other;
+    struct logmod_durable durable, failing;
+    struct logmod_sink sink, failing_sink;
+    struct logmod logmod;
+    pthread_t threads[DURABLE_THREADS];
+    char dir[] = "/tmp/logmod-test-XXXXXX", path[64];
+    int seen[DURABLE_RECORDS], count = 0, fd, original_stderr, error, i;
+    FILE *log_fp;
+    logmod_err code;
+    void *result;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    memset(seen, 0, sizeof seen);
+    ASSERT_NEQ(NULL, mkdtemp(dir));
+    sprintf(path, "%s/audit.log", dir);
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    ASSERT(fd >= 0);
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+    logmod_logger_set_quiet(logger, 1);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init_durable(&sink, &durable, fd, buffers[0],
+                                       sizeof buffers[0], 1000,
+                                       LOGMOD_LEVEL_INFO, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(logger, &sink));
+
+    /* larger than a buffer, committed on its own */
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_nlog(INFO, logger,
+                          ("Record %d %s", DURABLE_RECORDS, payload), 2));
+    ASSERT_EQ(1, durable.committed);
+    for (i = 0; i < DURABLE_THREADS; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, durable_producer,
+                                    logger));
+    }
+    for (i = 0; i < DURABLE_THREADS; ++i) {
+        pthread_join(threads[i], &result);
+        ASSERT_EQ(NULL, result);
+    }
+    ASSERT_EQ(DURABLE_THREADS * DURABLE_RECORDS + 1, durable.committed);
+    ASSERT_EQ(0, durable.failed);
+    ASSERT_LT(durable.commits, durable.committed);
+
+    /* on disk already, as each call returned */
+    ASSERT(read_record_numbers(path, numbers, &count));
+    ASSERT_EQ(DURABLE_THREADS * DURABLE_RECORDS + 1, count);
+    ASSERT_EQ(DURABLE_RECORDS, numbers[0]);
+    for (i = 1; i < count; ++i) {
+        ASSERT(numbers[i] >= 0 && numbers[i] < DURABLE_RECORDS);
+        ++seen[numbers[i]];
+    }
+    for (i = 0; i < DURABLE_RECORDS; ++i) {
+        ASSERT_EQ(DURABLE_THREADS, seen[i]);
+    }
+
+    /* a batch that can't be written fails its logging calls */
+    other = logmod_get_logger(&logmod, "MODULE_B");
+    logmod_logger_set_quiet(other, 1);
+    ASSERT((fd = open("/dev/null", O_RDONLY)) >= 0);
+    ASSERT_EQ(LOGMOD_OK,
+              logmod_sink_init_durable(&failing_sink, &failing, fd,
+                                       buffers[0], sizeof buffers[0], 0,
+                                       LOGMOD_LEVEL_INFO, LOGMOD_SINK_PLAIN));
+    ASSERT_EQ(LOGMOD_OK, logmod_logger_add_sink(other, &failing_sink));
+    errno = 0;
+    ASSERT_EQ(LOGMOD_ERRNO, logmod_nlog(INFO, other, ("Lost"), 0));
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(1, failing.failed);
+
+    /* larger than a buffer, fails without logging */
+    original_stderr = dup(STDERR_FILENO);
+    log_fp = tmpfile();
+    dup2(fileno(log_fp), STDERR_FILENO);
+    errno = 0;
+    code = logmod_nlog(INFO, other, ("Lost %s", payload), 1);
+    error = errno;
+    fflush(stderr);
+    dup2(original_stderr, STDERR_FILENO);
+    close(original_stderr);
+    ASSERT_EQ(LOGMOD_ERRNO, code);
+    ASSERT_EQ(EBADF, error);
+    ASSERT_EQ(0, lseek(fileno(log_fp), 0, SEEK_END));
+    fclose(log_fp);
+    ASSERT_EQ(2, failing.failed);
+
+    /* only the records of the batches that failed are reported */
+    ASSERT(dup2(sink.fd, fd) >= 0);
+    ASSERT_EQ(LOGMOD_OK, logmod_nlog(INFO, other, ("Kept"), 0));
+    ASSERT_EQ(2, failing.failed);
+    ASSERT_EQ(3, failing.committed);
+
+    logmod_cleanup(&logmod);
+    close(fd);
+    close(sink.fd);
+    unlink(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST
+should_render_prefix_after_option_changes(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static char long_context_id[LOGMOD_IDENTITY_SIZE * 2];
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod_options options = { 0 };
+    struct logmod logmod;
+    FILE *fp = tmpfile();
+    char buffer[2048], *line;
+    size_t bytes_read;
+
+    memset(long_context_id, 'X', sizeof(long_context_id) - 1);
+    options.quiet = 1;
+    options.suppress_time = 1;
+    options.hide_counter = 1;
+    options.logfile = fp;
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logmod_set_options(&logmod, options);
+    logger = logmod_get_logger(&logmod, "MODULE_A");
+
+    logmod_nlog(INFO, logger, ("first"), 0);
+    logmod_logger_set_id_visibility(logger, 1, 0);
+    logmod_nlog(INFO, logger, ("second"), 0);
+    options.show_application_id = 1;
+    logmod_logger_set_options(logger, options);
+    logmod_nlog(INFO, logger, ("third"), 0);
+    /* IDs too long to be pre-rendered */
+    logger = logmod_get_logger(&logmod, long_context_id);
+    logmod_nlog(INFO, logger, ("fourth"), 0);
+
+    rewind(fp);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[bytes_read] = '\0';
+    line = strtok(buffer, "\n");
+    ASSERT_EQ(line, strstr(line, "MODULE_A » INFO "));
+    line = strtok(NULL, "\n");
+    ASSERT_EQ(line, strstr(line, "APPLICATION_A » INFO "));
+    line = strtok(NULL, "\n");
+    ASSERT_EQ(line, strstr(line, "APPLICATION_A » MODULE_A » INFO "));
+    line = strtok(NULL, "\n");
+    ASSERT_EQ(0, strncmp(line, long_context_id, sizeof(long_context_id) - 1));
+    ASSERT_NEQ(NULL, strstr(line, " » INFO "));
+
+    logmod_cleanup(&logmod);
+    fclose(fp);
+    PASS();
+}
+
+static int
+count_evaluation(int *counter)
+{
+    return ++*counter;
+}
+
+TEST
+should_strip_levels_below_compile_min_level(void)
+{
+    static const char *const application_id = "APPLICATION_A";
+    static const char *const context_id = "MODULE_A";
+    struct logmod_logger table[TABLE_LENGTH], *logger;
+    struct logmod logmod;
+    int evaluations = 0;
+    logmod_err code;
+
+    logmod_init(&logmod, application_id, table, sizeof(table) / sizeof *table);
+    logger = logmod_get_logger(&logmod, context_id);
+    logmod_logger_set_callback(logger, NULL, 0, test_callback);
+    logmod_logger_set_level(logger, LOGMOD_LEVEL_TRACE);
+
+    callback_was_called = 0;
+    code = logmod_nlog(TRACE, logger,
+                       ("Stripped %d", count_evaluation(&evaluations)), 1);
+    ASSERT_EQ(LOGMOD_OK_SKIPPED, code);
+    ASSERT_EQ(0, evaluations);
+    ASSERT_EQ(0, callback_was_called);
+
+    code = logmod_nlog(DEBUG, logger,
+                       ("Compiled %d", count_evaluation(&evaluations)), 1);
+    ASSERT_EQ(LOGMOD_OK, code);
+    ASSERT_EQ(1, evaluations);
+    ASSERT_EQ(1, callback_was_called);
+
+    callback_was_called = 0;
+    logmod_logger_set_callback(logger, custom_labels,
+                               sizeof(custom_labels) / sizeof *custom_labels,
+                               test_callback);
+    logmod_nlog(HTTP, logger, ("Custom level"), 0);
+    ASSERT_EQ(1, callback_was_called);
 
     PASS();
 }
@@ -552,6 +2731,8 @@ SUITE(initialization)
 {
     RUN_TEST(should_initialize_application);
     RUN_TEST(should_initialize_context);
+    RUN_TEST(should_look_up_loggers_by_context);
+    RUN_TEST(should_cache_logger_per_call_site);
 }
 
 SUITE(logger_options)
@@ -574,6 +2755,36 @@ SUITE(logging)
     RUN_TEST(should_get_correct_level_labels);
     RUN_TEST(should_get_level_by_label_name);
     RUN_TEST(should_use_fallback_logger);
+    RUN_TEST(should_skip_filtered_levels_before_callback);
+    RUN_TEST(should_forward_filtered_levels_to_opted_in_callback);
+    RUN_TEST(should_strip_levels_below_compile_min_level);
+    RUN_TEST(should_write_records_larger_than_buffer);
+    RUN_TEST(should_share_formatted_message_with_callback);
+    RUN_TEST(should_format_like_printf);
+    RUN_TEST(should_cache_rendered_time);
+    RUN_TEST(should_timestamp_with_clock_sources);
+    RUN_TEST(should_render_time_formats);
+    RUN_TEST(should_carry_sequence_number_in_info);
+    RUN_TEST(should_log_asynchronously);
+    RUN_TEST(should_drain_async_queue_on_cleanup);
+    RUN_TEST(should_defer_formatting_to_async_writer);
+    RUN_TEST(should_write_binary_records);
+    RUN_TEST(should_flush_logfile_as_per_policy);
+    RUN_TEST(should_dispatch_records_to_sinks);
+    RUN_TEST(should_apply_async_overflow_policy);
+    RUN_TEST(should_drop_oldest_records_under_concurrent_producers);
+    RUN_TEST(should_prioritize_severe_records);
+    RUN_TEST(should_write_sync_records_through_busy_writer);
+    RUN_TEST(should_merge_staged_records_in_order);
+    RUN_TEST(should_write_records_to_file_descriptor);
+    RUN_TEST(should_append_records_to_memory_mapped_file);
+    RUN_TEST(should_reserve_memory_mapped_file_space_across_threads);
+    RUN_TEST(should_write_records_through_io_uring);
+    RUN_TEST(should_report_io_uring_write_errors);
+    RUN_TEST(should_rotate_file_sink_by_size);
+    RUN_TEST(should_rotate_file_sink_by_interval);
+    RUN_TEST(should_commit_durable_records_in_groups);
+    RUN_TEST(should_render_prefix_after_option_changes);
 }
 
 SUITE(ansi)
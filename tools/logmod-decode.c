@@ -0,0 +1,385 @@
+/*
+ * logmod-decode: turn a binary log stream (see logmod_binary_init()) back
+ * into the text LogMod would have written.
+ *
+ * Usage: logmod-decode [-c] [-l LEVEL] [-x CONTEXT] [FILE]
+ *   -c          render ANSI colors, as on the console
+ *   -l LEVEL    skip records below LEVEL (label name or number)
+ *   -x CONTEXT  only decode records from the CONTEXT logger
+ *
+ * Reads from stdin when FILE is omitted. The stream must have been written
+ * on a platform with the same data model, as arguments are stored raw.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include "logmod.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SITE_STRINGS 8
+/* call site IDs are rejected from this one up, well past any site table a
+   writer is likely to have, so that a corrupted ID can't grow ours */
+#define SITE_LIMIT (1UL << 24)
+
+/** @brief Decoded call site, rendered with its own logger */
+struct site {
+    struct logmod logmod;
+    struct logmod_logger table[1];
+    struct logmod_logger *logger;
+    struct logmod_label *label;
+    char *strings[SITE_STRINGS]; /* label name, style, visibility, color,
+                                    application id, context id, filename,
+                                    format */
+    unsigned level;
+    unsigned line;
+};
+
+struct decoder {
+    FILE *input;
+    int color;
+    long min_level; /* -1 if every level is decoded */
+    const char *min_level_name; /* custom label min_level is resolved from,
+                                   before decoding */
+    const char *context_id;
+    struct site **sites;
+    unsigned long num_sites;
+    logmod_uint64 timestamp;
+    long counter;
+    long utc_offset;
+    char packed[LOGMOD_BUFFER_SIZE];
+};
+
+static void
+die(const char *message)
+{
+    fprintf(stderr, "logmod-decode: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static logmod_uint64
+read_varint(struct decoder *decoder)
+{
+    logmod_uint64 value = 0;
+    int shift = 0, c;
+    do {
+        if ((c = getc(decoder->input)) == EOF || shift > 63)
+            die("truncated stream");
+        value |= (logmod_uint64)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return value;
+}
+
+static logmod_uint64
+read_delta(struct decoder *decoder)
+{
+    const logmod_uint64 value = read_varint(decoder);
+    return value & 1 ? ~(value >> 1) : value >> 1;
+}
+
+static size_t
+read_bytes(struct decoder *decoder, char *dest, size_t size)
+{
+    const logmod_uint64 length = read_varint(decoder);
+    if (length >= size) die("corrupted stream");
+    if (fread(dest, 1, (size_t)length, decoder->input) != length)
+        die("truncated stream");
+    dest[length] = '\0';
+    return (size_t)length;
+}
+
+static char *
+read_string(struct decoder *decoder)
+{
+    const logmod_uint64 length = read_varint(decoder);
+    char *str;
+    if (length >= LOGMOD_BUFFER_SIZE) die("corrupted stream");
+    if (!(str = malloc((size_t)length + 1))) die("out of memory");
+    if (fread(str, 1, (size_t)length, decoder->input) != length)
+        die("truncated stream");
+    str[length] = '\0';
+    return str;
+}
+
+static void
+read_header(struct decoder *decoder)
+{
+    static const unsigned short endianness = 1;
+    const unsigned char expected[] = { 'L', 'O', 'G', 'M', 'O', 'D',
+                                       LOGMOD_BINARY_VERSION,
+                                       sizeof(int), sizeof(long),
+                                       sizeof(double), sizeof(long double),
+                                       sizeof(void *), sizeof(logmod_uint64),
+                                       *(const unsigned char *)&endianness };
+    unsigned char header[sizeof expected];
+    if (fread(header, 1, sizeof header, decoder->input) != sizeof header
+        || memcmp(header, expected, 6) != 0)
+    {
+        die("not a LogMod binary stream");
+    }
+    if (header[6] != LOGMOD_BINARY_VERSION)
+        die("unsupported binary format version");
+    if (memcmp(header, expected, sizeof header) != 0)
+        die("stream was written on a platform with a different data model");
+}
+
+static void
+site_free(struct site *site)
+{
+    size_t i;
+    if (!site) return;
+    for (i = 0; i < sizeof site->strings / sizeof *site->strings; ++i)
+        free(site->strings[i]);
+    free(site->label);
+    free(site);
+}
+
+static void
+read_site(struct decoder *decoder)
+{
+    const logmod_uint64 number = read_varint(decoder);
+    const unsigned long id = (unsigned long)number;
+    struct site *site;
+    unsigned flags;
+    size_t i;
+
+    if (number >= SITE_LIMIT) die("corrupted stream");
+    if (!(site = calloc(1, sizeof *site))) die("out of memory");
+    site->level = (unsigned)read_varint(decoder);
+    site->line = (unsigned)read_varint(decoder);
+    flags = (unsigned)read_varint(decoder);
+    for (i = 0; i < sizeof site->strings / sizeof *site->strings; ++i)
+        site->strings[i] = read_string(decoder);
+
+    {
+        const struct logmod_label label = { site->strings[0],
+                                            site->strings[1],
+                                            site->strings[2],
+                                            site->strings[3], 0 };
+        if (!(site->label = malloc(sizeof *site->label)))
+            die("out of memory");
+        memcpy(site->label, &label, sizeof label);
+    }
+    logmod_init(&site->logmod, site->strings[4], site->table, 1);
+    site->logger = logmod_get_logger(&site->logmod, site->strings[5]);
+    logmod_logger_set_counter(site->logger, !(flags & 1));
+    logmod_logger_set_time(site->logger, !(flags & 2));
+    logmod_logger_set_id_visibility(site->logger, (flags & 4) != 0,
+                                    !(flags & 8));
+    logmod_logger_set_time_format(site->logger,
+                                  (enum logmod_time_formats)(flags >> 4));
+    logmod_logger_set_color(site->logger, decoder->color);
+
+    if (id >= decoder->num_sites) {
+        unsigned long num_sites = decoder->num_sites ? decoder->num_sites : 64;
+        struct site **sites;
+        /* no wraparound: SITE_LIMIT is a power of two, past id */
+        while (num_sites <= id)
+            num_sites *= 2;
+        sites = realloc(decoder->sites, num_sites * sizeof *sites);
+        if (!sites) die("out of memory");
+        memset(sites + decoder->num_sites, 0,
+               (num_sites - decoder->num_sites) * sizeof *sites);
+        decoder->sites = sites;
+        decoder->num_sites = num_sites;
+    }
+    site_free(decoder->sites[id]);
+    decoder->sites[id] = site;
+}
+
+static void
+read_record(struct decoder *decoder, const int packed)
+{
+    static struct _logmod_record record;
+    const unsigned long id = (unsigned long)read_varint(decoder);
+    struct _logmod_buffer *body = &record.message.body;
+    struct site *site;
+    char cached[sizeof "YYYY-MM-DDTHH:MM:SS+hh:mm"];
+    time_t seconds;
+    size_t length;
+
+    if (id >= decoder->num_sites || !(site = decoder->sites[id]))
+        die("record refers to an unknown call site");
+    decoder->timestamp += read_delta(decoder);
+    decoder->counter += (long)read_delta(decoder);
+
+    body->data = record.message.data + LOGMOD_PREFIX_SIZE;
+    body->size = LOGMOD_BUFFER_SIZE;
+    body->length = 0;
+    body->overflow = 0;
+    if (packed) {
+        length = read_bytes(decoder, decoder->packed, sizeof decoder->packed);
+        record.packed = decoder->packed;
+        record.packed_length = length;
+        record.formatted = 0;
+    }
+    else {
+        body->length = read_bytes(decoder, body->data, body->size);
+        record.packed = NULL;
+        record.formatted = 1;
+    }
+
+    if ((decoder->min_level >= 0 && (long)site->level < decoder->min_level)
+        || (decoder->context_id
+            && strcmp(decoder->context_id, site->logger->context_id) != 0))
+    {
+        return;
+    }
+
+    _logmod_record_populate(&record, site->label, site->line,
+                            site->strings[6], site->level, decoder->counter,
+                            decoder->timestamp);
+    record.fmt = site->strings[7];
+    record.args = NULL;
+    record.utc_offset = (int)decoder->utc_offset;
+    seconds = (time_t)(decoder->timestamp / LOGMOD_NSEC_PER_SEC)
+              + (time_t)decoder->utc_offset * 60;
+    gmtime_r(&seconds, (struct tm *)&record.info.time);
+    _logmod_time_format(&record.info.time, decoder->utc_offset, cached);
+    _logmod_record_time_render(&record, site->logger->options.time_format,
+                               cached);
+    _logmod_record_format(&record);
+    if (_logmod_print(site->logger, &record, decoder->color, stdout)
+        != LOGMOD_OK)
+    {
+        die("couldn't write to stdout");
+    }
+}
+
+/**
+ * Find the level of the custom label `min_level_name` in a first pass over
+ * the stream, so that records logged before the first call site with that
+ * label are filtered as well. Streams that can't be rewound (pipes) are
+ * spooled to a temporary file first.
+ */
+static void
+resolve_min_level(struct decoder *decoder)
+{
+    int c;
+    if (fseek(decoder->input, 0, SEEK_CUR) != 0) {
+        FILE *spool = tmpfile();
+        char chunk[BUFSIZ];
+        size_t length;
+        if (!spool) die("couldn't create a temporary file");
+        while ((length = fread(chunk, 1, sizeof chunk, decoder->input)))
+            if (fwrite(chunk, 1, length, spool) != length)
+                die("couldn't write to a temporary file");
+        if (ferror(decoder->input)) die("couldn't read input");
+        if (decoder->input != stdin) fclose(decoder->input);
+        decoder->input = spool;
+        rewind(decoder->input);
+    }
+    read_header(decoder);
+    while (decoder->min_level < 0 && (c = getc(decoder->input)) != EOF) {
+        switch (c) {
+        case 'S': {
+            unsigned level;
+            char *name;
+            int i;
+            read_varint(decoder); /* id */
+            level = (unsigned)read_varint(decoder);
+            read_varint(decoder); /* line */
+            read_varint(decoder); /* flags */
+            name = read_string(decoder);
+            if (0 == strcmp(decoder->min_level_name, name))
+                decoder->min_level = (long)level;
+            free(name);
+            for (i = 1; i < SITE_STRINGS; ++i)
+                free(read_string(decoder));
+        } break;
+        case 'Z':
+            read_delta(decoder);
+            break;
+        case 'R':
+        case 'T':
+            read_varint(decoder); /* site id */
+            read_delta(decoder); /* timestamp */
+            read_delta(decoder); /* counter */
+            read_bytes(decoder, decoder->packed, sizeof decoder->packed);
+            break;
+        default:
+            die("corrupted stream");
+        }
+    }
+    if (decoder->min_level < 0) die("no call site has the given level");
+    rewind(decoder->input);
+}
+
+static void
+usage(void)
+{
+    fputs("usage: logmod-decode [-c] [-l LEVEL] [-x CONTEXT] [FILE]\n",
+          stderr);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct decoder decoder;
+    const char *path = NULL;
+    unsigned long i;
+    int c, arg;
+
+    decoder.min_level = -1;
+    for (arg = 1; arg < argc; ++arg) {
+        if (0 == strcmp(argv[arg], "-c")) {
+            decoder.color = 1;
+        }
+        else if (0 == strcmp(argv[arg], "-l") && arg + 1 < argc) {
+            const char *level = argv[++arg];
+            char *end;
+            decoder.min_level = strtol(level, &end, 10);
+            if (*end != '\0') {
+                /* built-in label, or custom label resolved by its sites */
+                struct logmod_logger table[1];
+                struct logmod logmod;
+                logmod_init(&logmod, "DECODE", table, 1);
+                decoder.min_level = logmod_logger_get_level(
+                    logmod_get_logger(&logmod, "DECODE"), level);
+                if (decoder.min_level < 0) {
+                    decoder.min_level = -1;
+                    decoder.min_level_name = level;
+                }
+            }
+        }
+        else if (0 == strcmp(argv[arg], "-x") && arg + 1 < argc) {
+            decoder.context_id = argv[++arg];
+        }
+        else if (argv[arg][0] == '-' || path) {
+            usage();
+        }
+        else {
+            path = argv[arg];
+        }
+    }
+
+    decoder.input = path ? fopen(path, "rb") : stdin;
+    if (!decoder.input) die("couldn't open input file");
+    if (decoder.min_level_name) resolve_min_level(&decoder);
+    read_header(&decoder);
+    while ((c = getc(decoder.input)) != EOF) {
+        switch (c) {
+        case 'S':
+            read_site(&decoder);
+            break;
+        case 'Z':
+            decoder.utc_offset = (long)read_delta(&decoder);
+            break;
+        case 'R':
+        case 'T':
+            read_record(&decoder, c == 'R');
+            break;
+        default:
+            die("corrupted stream");
+        }
+    }
+
+    for (i = 0; i < decoder.num_sites; ++i)
+        site_free(decoder.sites[i]);
+    free(decoder.sites);
+    if (decoder.input != stdin) fclose(decoder.input);
+    return EXIT_SUCCESS;
+}